@@ -0,0 +1,250 @@
+// This file is part of PGM-index <https://github.com/gvinciguerra/PGM-index>.
+// Copyright (c) 2021 Giorgio Vinciguerra.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "pgm/pgm_index.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Classic (non-learned) indexes with the same interface of the PGM-index, to be used as a reference in the benchmark.
+ *
+ * Like the PGM-index, they do not store the data but return a range of positions where a key may be found, which the
+ * benchmark then searches with std::lower_bound. The tree-based ones index one key out of every PageSize, so the
+ * returned range has at most PageSize elements.
+ */
+namespace baseline {
+
+using pgm::ApproxPos;
+
+namespace internal {
+
+/** Returns the keys at positions 0, PageSize, 2 * PageSize, ... of the given sorted range. */
+template<typename K, size_t PageSize, typename RandomIt>
+std::vector<K> sample_keys(RandomIt first, RandomIt last) {
+    static_assert(PageSize > 0);
+    auto n = size_t(std::distance(first, last));
+    std::vector<K> samples;
+    samples.reserve((n + PageSize - 1) / PageSize);
+    for (size_t i = 0; i < n; i += PageSize)
+        samples.push_back(first[i]);
+    return samples;
+}
+
+/**
+ * Returns the range of positions of the data where the lower bound of a key may be, given the index @p j of the first
+ * sampled key that is greater than or equal to it.
+ */
+template<size_t PageSize>
+ApproxPos page_range(size_t j, size_t num_samples, size_t n) {
+    auto lo = j == 0 ? 0 : (j - 1) * PageSize + 1;
+    auto hi = j == num_samples ? n : j * PageSize;
+    return {lo, lo, hi};
+}
+
+} // namespace internal
+
+/**
+ * A plain binary search over the whole data, which uses no space.
+ * @tparam K the type of the indexed keys
+ */
+template<typename K>
+class BinarySearch {
+    size_t n;
+
+public:
+
+    using K_type = K;
+
+    template<typename RandomIt>
+    BinarySearch(RandomIt first, RandomIt last) : n(std::distance(first, last)) {}
+
+    ApproxPos search(const K &) const { return {0, 0, n}; }
+
+    size_t size_in_bytes() const { return 0; }
+};
+
+/**
+ * A static B+-tree stored implicitly in an array of cache-line-sized nodes, where each node stores the largest key of
+ * each of its children and a search visits one node per level.
+ * @tparam K the type of the indexed keys
+ * @tparam PageSize the number of elements of the data covered by each key in the leaves
+ */
+template<typename K, size_t PageSize = 64>
+class BPlusTree {
+    static constexpr size_t node_size = std::max<size_t>(64 / sizeof(K), 2);
+
+    size_t n;                           ///< The number of elements in the data.
+    size_t num_samples;                 ///< The number of keys in the leaves.
+    std::vector<std::vector<K>> levels; ///< The levels of the tree, from the leaves up, padded to a multiple of node_size.
+
+public:
+
+    using K_type = K;
+
+    template<typename RandomIt>
+    BPlusTree(RandomIt first, RandomIt last) : n(std::distance(first, last)) {
+        auto level = internal::sample_keys<K, PageSize>(first, last);
+        num_samples = level.size();
+        do {
+            level.resize((level.size() + node_size - 1) / node_size * node_size, std::numeric_limits<K>::max());
+            levels.push_back(std::move(level));
+            auto &below = levels.back();
+            level.clear();
+            for (size_t i = node_size - 1; i < below.size(); i += node_size)
+                level.push_back(below[i]);
+        } while (levels.back().size() > node_size);
+    }
+
+    ApproxPos search(const K &key) const {
+        if (num_samples == 0)
+            return {0, 0, 0};
+        size_t j = 0;
+        for (auto l = levels.size(); l-- > 0;) {
+            auto node = levels[l].data() + j * node_size;
+            size_t i = 0;
+            for (size_t k = 0; k < node_size; ++k)
+                i += node[k] < key;
+            j = j * node_size + (l > 0 ? std::min(i, node_size - 1) : i);
+        }
+        return internal::page_range<PageSize>(std::min(j, num_samples), num_samples, n);
+    }
+
+    size_t size_in_bytes() const {
+        size_t bytes = 0;
+        for (auto &l : levels)
+            bytes += l.size() * sizeof(K);
+        return bytes;
+    }
+};
+
+/**
+ * A binary search over keys stored in the Eytzinger (BFS) layout, where the hot top levels of the implicit tree share
+ * few cache lines and the next nodes to visit can be prefetched.
+ * @tparam K the type of the indexed keys
+ * @tparam PageSize the number of elements of the data covered by each key in the tree
+ */
+template<typename K, size_t PageSize = 64>
+class EytzingerSearch {
+    static constexpr size_t prefetch_distance = std::max<size_t>(64 / sizeof(K), 1); ///< Descendants in a cache line.
+
+    size_t n;                   ///< The number of elements in the data.
+    std::vector<K> keys;        ///< The sampled keys in Eytzinger layout, starting from position 1.
+    std::vector<size_t> ranks;  ///< The rank among the sampled keys of each element of keys.
+
+    template<typename It>
+    It build(It it, size_t k) {
+        if (k < keys.size()) {
+            it = build(it, 2 * k);
+            ranks[k] = it.second;
+            keys[k] = *it.first;
+            ++it.first;
+            ++it.second;
+            it = build(it, 2 * k + 1);
+        }
+        return it;
+    }
+
+public:
+
+    using K_type = K;
+
+    template<typename RandomIt>
+    EytzingerSearch(RandomIt first, RandomIt last) : n(std::distance(first, last)) {
+        auto samples = internal::sample_keys<K, PageSize>(first, last);
+        keys.resize(samples.size() + 1);
+        ranks.resize(samples.size() + 1, samples.size());
+        build(std::make_pair(samples.cbegin(), size_t(0)), 1);
+    }
+
+    ApproxPos search(const K &key) const {
+        size_t k = 1;
+        while (k < keys.size()) {
+            __builtin_prefetch(keys.data() + k * prefetch_distance);
+            k = 2 * k + (keys[k] < key);
+        }
+        k >>= __builtin_ffsll(~k);
+        return internal::page_range<PageSize>(ranks[k], keys.size() - 1, n);
+    }
+
+    size_t size_in_bytes() const { return keys.size() * sizeof(K) + ranks.size() * sizeof(size_t); }
+};
+
+/**
+ * A table that maps the most significant @p Bits bits of a key (after subtracting the smallest key) to the position
+ * of the first key with those bits. A search is a single lookup followed by a search in the returned range, whose size
+ * depends on how skewed the data is.
+ * @tparam K the type of the indexed keys
+ * @tparam Bits the number of bits used to address the table
+ */
+template<typename K, uint8_t Bits = 20>
+class RadixTable {
+    static_assert(std::is_integral_v<K>);
+    static_assert(Bits > 0 && Bits < 8 * sizeof(size_t));
+
+    using U = std::make_unsigned_t<K>;
+
+    size_t n;                   ///< The number of elements in the data.
+    K first_key;                ///< The smallest key.
+    K last_key;                 ///< The largest key.
+    uint8_t shift;              ///< The number of least significant bits dropped from a key.
+    std::vector<size_t> table;  ///< The position of the first key of each prefix, plus n at the end.
+
+    size_t prefix(const K &key) const { return size_t(U(U(key) - U(first_key)) >> shift); }
+
+public:
+
+    using K_type = K;
+
+    template<typename RandomIt>
+    RadixTable(RandomIt first, RandomIt last) : n(std::distance(first, last)), shift(0) {
+        if (n == 0)
+            return;
+        first_key = *first;
+        last_key = *std::prev(last);
+        auto span = U(U(last_key) - U(first_key));
+        auto span_bits = span == 0 ? 0 : 64 - __builtin_clzll(uint64_t(span));
+        shift = span_bits > Bits ? span_bits - Bits : 0;
+
+        table.resize(prefix(last_key) + 2);
+        size_t p = 0;
+        for (size_t i = 0; i < n; ++i) {
+            auto q = prefix(first[i]);
+            while (p <= q)
+                table[p++] = i;
+        }
+        std::fill(table.begin() + p, table.end(), n);
+    }
+
+    ApproxPos search(const K &key) const {
+        if (n == 0 || key <= first_key)
+            return {0, 0, 0};
+        if (key > last_key)
+            return {n, n, n};
+        auto p = prefix(key);
+        return {table[p], table[p], table[p + 1]};
+    }
+
+    size_t size_in_bytes() const { return table.size() * sizeof(size_t); }
+};
+
+} // namespace baseline
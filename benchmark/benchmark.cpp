@@ -14,43 +14,237 @@
 // limitations under the License.
 
 #include "benchmark.hpp"
+#include "benchmark_dynamic.hpp"
+#include "benchmark_mapped.hpp"
+#include "baselines.hpp"
+#include "report.hpp"
+#include "mock_pgm_index.hpp"
 #include "args.hxx"
 #include "pgm/pgm_index.hpp"
 #include "pgm/pgm_index_variants.hpp"
 
 #include <fstream>
 #include <functional>
+#include <sstream>
+#include <tuple>
 #include <utility>
 
-#define FOR_EACH_EPS(C, K) C<K, 8>, C<K, 16>, C<K, 32>, C<K, 64>, C<K, 128>, C<K, 256>,  C<K, 512>, C<K, 1024>
-#define FOR_EACH_EPS_2(C, K, D) C<K, 8, D>, C<K, 16, D>, C<K, 32, D>, C<K, 64, D>, C<K, 128, D>, C<K, 256, D>, \
-                                C<K, 512, D>, C<K, 1024, D>
+#define BASELINE_CLASSES(K) baseline::BinarySearch<K>, \
+                            baseline::BPlusTree<K, 16>, baseline::BPlusTree<K, 64>, baseline::BPlusTree<K, 256>, \
+                            baseline::EytzingerSearch<K, 16>, baseline::EytzingerSearch<K, 64>, \
+                            baseline::EytzingerSearch<K, 256>, \
+                            baseline::RadixTable<K, 16>, baseline::RadixTable<K, 20>, baseline::RadixTable<K, 24>
 
-#define FOR_EACH_BPGM(C, K) FOR_EACH_EPS_2(C, K, 1 << 16), FOR_EACH_EPS_2(C, K, 1 << 20), FOR_EACH_EPS_2(C, K, 1 << 24)
+/**
+ * Calls f(type_wrapper<Class>{}, name, eps) for each variant in the options other than the baselines, and for each ε
+ * in the options. The classes of the variants take ε at construction time, so ε can take any value without
+ * recompiling.
+ */
+template<typename K, typename F>
+void for_each_variant(const BenchmarkOptions &options, F f) {
+    auto key_name = demangle(typeid(K).name());
+    for (auto &variant : options.variants) {
+        for (auto eps : options.epsilons) {
+            auto params = key_name + ", " + std::to_string(eps);
+            if (variant == "pgm")
+                f(type_wrapper<MockPGMIndex<K>>{}, "pgm::PGMIndex<" + params + ">", eps);
+            else if (variant == "bucketing") {
+                f(type_wrapper<MockBucketingPGMIndex<K, 1 << 16>>{}, "pgm::BucketingPGMIndex<" + params + ", 65536>", eps);
+                f(type_wrapper<MockBucketingPGMIndex<K, 1 << 20>>{}, "pgm::BucketingPGMIndex<" + params + ", 1048576>",
+                  eps);
+                f(type_wrapper<MockBucketingPGMIndex<K, 1 << 24>>{}, "pgm::BucketingPGMIndex<" + params + ", 16777216>",
+                  eps);
+            } else if (variant == "ef")
+                f(type_wrapper<MockEliasFanoPGMIndex<K>>{}, "pgm::EliasFanoPGMIndex<" + params + ">", eps);
+            else if (variant == "compressed")
+                f(type_wrapper<MockCompressedPGMIndex<K>>{}, "pgm::CompressedPGMIndex<" + params + ">", eps);
+        }
+    }
+}
+
+/** Runs the workloads on each variant and ε in the options, and on the baselines. */
+template<typename K>
+void benchmark_variants(const std::string &filename, const std::vector<char> &data, size_t record_size,
+                        const BenchmarkOptions &options, ResultWriter &writer) {
+    auto begin = RecordIterator<K>(data.data(), record_size);
+    auto end = RecordIterator<K>(data.data() + data.size(), record_size);
+
+    for (auto &w : generate_workloads(begin, end, options)) {
+        auto run = [&](auto t, const std::string &name, auto... args) {
+            using class_type = typename decltype(t)::type;
+            writer.row(filename, w.distribution, name, benchmark<class_type>(begin, end, w, options, args...));
+        };
+
+        for_each_variant<K>(options, run);
+        if (std::find(options.variants.begin(), options.variants.end(), "baselines") != options.variants.end()) {
+            for_types<BASELINE_CLASSES(K)>([&](auto t) {
+                run(t, demangle(typeid(typename decltype(t)::type).name()));
+            });
+        }
+    }
+}
+
+/** The options of the build scaling benchmark. */
+struct BuildBenchmarkOptions {
+    std::vector<size_t> threads; ///< The numbers of threads to build with.
+    std::vector<size_t> sizes;   ///< The numbers of keys to build on, sampled evenly from each dataset.
+    size_t repetitions = 3;      ///< The number of builds of each configuration, of which the median time is reported.
+};
+
+inline std::string build_csv_header() {
+    return "dataset,class_name,keys,threads,chunks,build_ms,keys_per_sec,speedup,efficiency,segments,segment_inflation";
+}
+
+/**
+ * Builds each variant in the options with each number of threads, on samples of each size of the dataset, and reports
+ * the build throughput, the speedup and efficiency over one thread, and how many more segments the chunked parallel
+ * segmentation produces compared to the sequential one. The sequential build is always measured as the baseline, even
+ * if one thread is not among the requested ones.
+ */
+template<typename K>
+void benchmark_build(const std::string &dataset, const std::vector<K> &keys, const BenchmarkOptions &options,
+                     const BuildBenchmarkOptions &build_options) {
+#ifdef _OPENMP
+    auto max_threads = omp_get_max_threads();
+#endif
+    auto sizes = build_options.sizes.empty() ? std::vector<size_t>{keys.size()} : build_options.sizes;
+    for (auto size : sizes) {
+        size = std::min(size, keys.size());
+        std::vector<K> sample(size);
+        for (size_t i = 0; i < size; ++i)
+            sample[i] = keys[i * keys.size() / size];
+
+        for_each_variant<K>(options, [&](auto t, const std::string &name, size_t eps) {
+            using class_type = typename decltype(t)::type;
+
+            // Returns the median build time, the number of segments and of chunks with the given number of threads
+            auto measure = [&](size_t threads) {
+#ifdef _OPENMP
+                omp_set_num_threads(int(threads));
+#endif
+                std::vector<double> times;
+                size_t segments = 0;
+                for (size_t r = 0; r < build_options.repetitions; ++r) {
+                    auto t0 = timer::now();
+                    class_type index(sample.begin(), sample.end(), eps);
+                    auto t1 = timer::now();
+                    times.push_back(std::chrono::duration<double, std::milli>(t1 - t0).count());
+                    segments = index.segments_count();
+                }
+                std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+                return std::make_tuple(times[times.size() / 2], segments, pgm::internal::segmentation_chunks(size));
+            };
+
+            auto base = measure(1);
+            auto base_ms = std::get<0>(base);
+            auto base_segments = std::get<1>(base);
+            for (auto threads : build_options.threads) {
+                auto [ms, segments, chunks] = threads == 1 ? base : measure(threads);
+                auto speedup = base_ms / ms;
+                std::cout << dataset << ",\"" << name << "\"," << size << "," << threads << "," << chunks << "," << ms
+                          << ","
+                          << uint64_t(size / (ms / 1000)) << "," << speedup << "," << speedup / threads << ","
+                          << segments << "," << double(segments) / std::max<size_t>(base_segments, 1) << std::endl;
+            }
+        });
+    }
+#ifdef _OPENMP
+    omp_set_num_threads(max_threads);
+#endif
+}
 
-#define PGM_CLASSES(K) FOR_EACH_EPS(pgm::PGMIndex, K)
-#define BPGM_CLASSES(K) FOR_EACH_BPGM(pgm::BucketingPGMIndex, K)
-#define EFPGM_CLASSES(K) FOR_EACH_EPS(pgm::EliasFanoPGMIndex, K)
-#define CPGM_CLASSES(K) FOR_EACH_EPS(pgm::CompressedPGMIndex, K)
+/** The benchmark modes other than the default one, which runs the workloads on the variants and the baselines. */
+struct BenchmarkModes {
+    std::optional<DynamicBenchmarkOptions> dynamic;
+    std::optional<MappedBenchmarkOptions> mapped;
+    std::optional<BuildBenchmarkOptions> build;
+};
 
-#define ALL_CLASSES(K) PGM_CLASSES(K), BPGM_CLASSES(K), EFPGM_CLASSES(K), CPGM_CLASSES(K)
+template<typename K>
+void benchmark_dataset(const std::string &name, std::vector<K> keys, size_t record_size,
+                       const BenchmarkOptions &options, const BenchmarkModes &modes, ResultWriter &writer) {
+    writer.dataset(dataset_stats(name, keys));
+    if (modes.build)
+        benchmark_build(name, keys, options, *modes.build);
+    else if (modes.mapped)
+        benchmark_mapped(name, keys, options, *modes.mapped);
+    else if (modes.dynamic)
+        benchmark_dynamic(name, std::move(keys), options, *modes.dynamic);
+    else
+        benchmark_variants<K>(name, to_records(keys, record_size), record_size, options, writer);
+}
 
 template<typename K>
-void read_ints_helper(args::PositionalList<std::string> &files,
-                      size_t record_size,
-                      double lookup_ratio,
-                      const std::string &workload) {
+void read_ints_helper(args::PositionalList<std::string> &files, size_t record_size, const BenchmarkOptions &options,
+                      const BenchmarkModes &modes, ResultWriter &writer) {
     OUT_VERBOSE("Running with " << sizeof(K) << "-byte keys + " << record_size - sizeof(K) << "-byte values")
     for (const auto &file : files.Get()) {
-        auto data = to_records(read_data_binary<K>(file, true), record_size);
         auto filename = file.substr(file.find_last_of("/\\") + 1);
-        benchmark_all<K, ALL_CLASSES(K)>(filename, data, record_size, lookup_ratio, workload);
+        benchmark_dataset(filename, read_data_binary<K>(file, true), record_size, options, modes, writer);
+    }
+}
+
+template<typename T>
+std::vector<T> parse_list(const std::string &s) {
+    std::vector<T> out;
+    for (auto &item : split(s, ','))
+        out.push_back(T(std::stoul(item)));
+    return out;
+}
+
+/** Runs "benchmark compare old new", which compares two result files. */
+int compare_main(int argc, char **argv) {
+    using namespace args;
+    ArgumentParser p("Compares two result files of the benchmark, in CSV or JSON format, and exits with status 1 if "
+                     "some query time got slower. The slowdowns are tested for significance only if both files were "
+                     "run with at least 2 repetitions, otherwise the threshold alone decides them.");
+    p.Prog("benchmark compare");
+    p.helpParams.flagindent = 2;
+    p.helpParams.helpindent = 25;
+    p.helpParams.progindent = 0;
+    p.helpParams.descriptionindent = 0;
+
+    HelpFlag help(p, "help", "Display this help menu", {'h', "help"});
+    ValueFlag<double> alpha(p, "a", "Significance level of Welch's t-test", {"alpha"}, 0.05);
+    ValueFlag<double> threshold(p, "r", "Ignore relative changes of the query time smaller than r", {"threshold"}, 0.05);
+    Positional<std::string> old_file(p, "old", "The baseline result file", Options::Required);
+    Positional<std::string> new_file(p, "new", "The result file to compare against the baseline", Options::Required);
+
+    try {
+        p.ParseCLI(argc, argv);
+    }
+    catch (args::Help &) {
+        std::cout << p;
+        return 0;
+    }
+    catch (args::Error &e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << p;
+        return 1;
+    }
+
+    CompareOptions options;
+    options.alpha = alpha.Get();
+    options.threshold = threshold.Get();
+    try {
+        auto slowdowns = compare_results(read_results(old_file.Get()), read_results(new_file.Get()), options);
+        if (slowdowns > 0)
+            std::cerr << slowdowns << " slowdowns, those marked with \"?\" are not backed by a significance test."
+                      << std::endl;
+        return slowdowns > 0;
+    } catch (std::exception &e) {
+        std::cerr << "Cannot compare the result files: " << e.what() << "." << std::endl;
+        return 2;
     }
 }
 
 int main(int argc, char **argv) {
     using namespace args;
-    ArgumentParser p("Benchmark for the PGM-index library.");
+    if (argc > 1 && std::string(argv[1]) == "compare")
+        return compare_main(argc - 1, argv + 1);
+
+    ArgumentParser p("Benchmark for the PGM-index library.",
+                     "Run \"benchmark compare old new\" to compare two result files.");
     p.helpParams.flagindent = 2;
     p.helpParams.helpindent = 25;
     p.helpParams.progindent = 0;
@@ -60,11 +254,55 @@ int main(int argc, char **argv) {
     HelpFlag help(p, "help", "Display this help menu", {'h', "help"});
     Flag verbose(p, "", "Verbose output", {'v', "verbose"});
     ValueFlag<size_t> value_size(p, "bytes", "Size of the values associated to keys", {'V', "values"}, 0);
+    ValueFlag<size_t> threads(p, "n", "Run the queries on n pinned threads sharing the index", {'t', "threads"}, 1);
+    ValueFlag<size_t> latency(p, "k", "Record the latency of every k-th query and report percentiles", {'l', "latency"});
+    Flag counters(p, "", "Report hardware performance counters (Linux only)", {'c', "counters"});
+    ValueFlag<size_t> repetitions(p, "n", "Repeat each measurement n times and report the mean and standard deviation, "
+                                          "or the median with --build (default: 1, 3 with --build). \"benchmark "
+                                          "compare\" tests the significance of a change only with n >= 2",
+                                  {'R', "repetitions"});
+    ValueFlag<std::string> format(p, "format", "Output format, either csv or json", {"format"}, "csv");
+
+    ValueFlag<std::string> eps(p, "list", "Comma-separated values of epsilon to try", {'e', "eps"},
+                               "8,16,32,64,128,256,512,1024");
+    ValueFlag<std::string> variants(p, "list", "Comma-separated classes among pgm, bucketing, ef, compressed, baselines",
+                                    {"variants"}, "pgm,bucketing,ef,compressed,baselines");
 
     Group g1(p, "QUERY WORKLOAD OPTIONS (mutually exclusive):", Group::Validators::AtMostOne);
     ValueFlag<double> ratio(g1, "ratio", "Random workload with the given lookup ratio", {'r', "ratio"}, 0.333);
     ValueFlag<std::string> workload(g1, "file", "Custom workload file. Obeys the format of input files", {'w', "workload"});
 
+    Group g3(p, "QUERY DISTRIBUTION OPTIONS:");
+    ValueFlag<std::string> distributions(g3, "list", "Comma-separated query distributions among uniform, zipf, window, "
+                                                     "sorted, scan", {'d', "distributions"}, "uniform");
+    ValueFlag<double> skew(g3, "s", "Exponent of the zipf distribution", {"skew"}, 0.99);
+    ValueFlag<double> window(g3, "fraction", "Width of the sliding hot window, as a fraction of the keys", {"window"}, 0.01);
+    ValueFlag<size_t> batch(g3, "size", "Size of the batches of the sorted distribution", {"batch"}, 1000);
+    ValueFlag<double> scan(g3, "length", "Mean length of the range scans of the scan distribution", {"scan"}, 100);
+
+    Group g4(p, "DYNAMIC WORKLOAD OPTIONS:");
+    Flag dynamic(g4, "", "Benchmark DynamicPGMIndex under mixes of updates and queries", {"dynamic"});
+    ValueFlag<std::string> mixes(g4, "list", "Comma-separated YCSB workloads among a, b, c, d, e, f, or custom mixes "
+                                             "insert:update:erase:find:scan", {"mix"}, "a,b,c,d,e,f");
+    ValueFlag<std::string> bases(g4, "list", "Comma-separated values of base to try", {"bases"}, "4,8,16");
+    ValueFlag<std::string> buffer_levels(g4, "list", "Comma-separated values of buffer_level to try",
+                                         {"buffer-levels"}, "0");
+    ValueFlag<std::string> index_levels(g4, "list", "Comma-separated values of index_level to try",
+                                        {"index-levels"}, "0");
+
+    Group g5(p, "DISK-RESIDENT DATA OPTIONS:");
+    Flag mapped(g5, "", "Benchmark MappedPGMIndex on a file evicted from the page cache before each run", {"mapped"});
+    ValueFlag<std::string> mapped_dir(g5, "dir", "Directory of the files backing the indexes", {"mapped-dir"}, ".");
+    ValueFlag<size_t> cold(g5, "n", "Number of queries timed right after the eviction", {"cold"}, 10000);
+    Flag readahead(g5, "", "Keep the kernel readahead on the mapped file", {"readahead"});
+
+    Group g6(p, "BUILD SCALING OPTIONS:");
+    Flag build(g6, "", "Benchmark the construction of the variants with different numbers of threads", {"build"});
+    ValueFlag<std::string> build_threads(g6, "list", "Comma-separated numbers of threads (default: powers of two up "
+                                                     "to the number of cores)", {"build-threads"}, "");
+    ValueFlag<std::string> sizes(g6, "list", "Comma-separated numbers of keys, sampled from each dataset (default: all)",
+                                 {"sizes"}, "");
+
     Group g2(p, "INPUT DATA OPTIONS (mutually exclusive):", Group::Validators::Xor, Options::Required);
     ValueFlag<size_t> synthetic(g2, "size", "Generate synthetic data of the given size", {'s', "synthetic"}, 100000000);
     Flag u64(g2, "", "Input files contain unsigned 64-bit ints", {'U', "u64"});
@@ -98,8 +336,129 @@ int main(int argc, char **argv) {
         return 1;
     }
 
+    if (threads.Get() == 0) {
+        std::cerr << "Argument to --" << threads.GetMatcher().GetLongOrAny().str() << " must be greater than 0.";
+        return 1;
+    }
+
+    BenchmarkOptions options;
+    options.lookup_ratio = ratio.Get();
+    options.workload = workload.Get();
+    options.threads = threads.Get();
+    options.distributions = split(distributions.Get(), ',');
+    options.zipf_skew = skew.Get();
+    options.window = window.Get();
+    options.batch_size = std::max<size_t>(batch.Get(), 1);
+    options.scan_length = scan.Get();
+    for (auto &d : options.distributions) {
+        if (d != "uniform" && d != "zipf" && d != "window" && d != "sorted" && d != "scan") {
+            std::cerr << "Unknown query distribution " << d << "." << std::endl;
+            return 1;
+        }
+    }
+    options.variants = split(variants.Get(), ',');
+    for (auto &v : options.variants) {
+        if (v != "pgm" && v != "bucketing" && v != "ef" && v != "compressed" && v != "baselines") {
+            std::cerr << "Unknown variant " << v << "." << std::endl;
+            return 1;
+        }
+    }
+    options.epsilons.clear();
+    for (auto &e : split(eps.Get(), ',')) {
+        auto value = std::strtoull(e.c_str(), nullptr, 10);
+        if (value == 0) {
+            std::cerr << "Argument to --" << eps.GetMatcher().GetLongOrAny().str() << " must contain positive integers.";
+            return 1;
+        }
+        options.epsilons.push_back(value);
+    }
+    options.repetitions = repetitions ? std::max<size_t>(repetitions.Get(), 1) : 1;
+    options.format = format.Get();
+    if (options.format != "csv" && options.format != "json") {
+        std::cerr << "Unknown output format " << options.format << "." << std::endl;
+        return 1;
+    }
+    if (options.format == "json" && (dynamic || mapped || build)) {
+        std::cerr << "Option --" << format.GetMatcher().GetLongOrAny().str() << " json is not supported by the "
+                  << "dynamic, mapped and build benchmarks." << std::endl;
+        return 1;
+    }
+    options.latency_sample = latency.Get();
+    options.counters = counters.Get();
+    if (options.counters && !PerfCounters().available())
+        std::cerr << "Warning: hardware performance counters are not available, their columns will be empty." << std::endl;
+
+    if (int(dynamic.Get()) + int(mapped.Get()) + int(build.Get()) > 1) {
+        std::cerr << "Options --" << dynamic.GetMatcher().GetLongOrAny().str() << ", --"
+                  << mapped.GetMatcher().GetLongOrAny().str() << " and --" << build.GetMatcher().GetLongOrAny().str()
+                  << " are mutually exclusive.";
+        return 1;
+    }
+
+    BenchmarkModes modes;
+    if (dynamic) {
+        auto &dyn_options = modes.dynamic.emplace();
+        try {
+            for (auto &m : split(mixes.Get(), ','))
+                dyn_options.mixes.push_back(OperationMix::parse(m));
+            dyn_options.bases = parse_list<uint8_t>(bases.Get());
+            dyn_options.buffer_levels = parse_list<uint8_t>(buffer_levels.Get());
+            dyn_options.index_levels = parse_list<uint8_t>(index_levels.Get());
+        } catch (std::exception &e) {
+            std::cerr << "Invalid dynamic workload options: " << e.what() << "." << std::endl;
+            return 1;
+        }
+        for (auto b : dyn_options.bases) {
+            if (b < 2) {
+                std::cerr << "Argument to --" << bases.GetMatcher().GetLongOrAny().str() << " must be at least 2.";
+                return 1;
+            }
+        }
+    }
+
+    if (mapped) {
+        auto &mapped_options = modes.mapped.emplace();
+        mapped_options.directory = mapped_dir.Get();
+        mapped_options.cold_queries = cold.Get();
+        mapped_options.readahead = readahead.Get();
+    }
+
+    if (build) {
+        auto &build_options = modes.build.emplace();
+        try {
+            build_options.threads = parse_list<size_t>(build_threads.Get());
+            build_options.sizes = parse_list<size_t>(sizes.Get());
+        } catch (std::exception &e) {
+            std::cerr << "Invalid build scaling options: " << e.what() << "." << std::endl;
+            return 1;
+        }
+        if (build_options.threads.empty()) {
+            for (size_t t = 1; t < size_t(omp_get_num_procs()); t *= 2)
+                build_options.threads.push_back(t);
+            build_options.threads.push_back(omp_get_num_procs());
+        }
+        if (std::count(build_options.threads.begin(), build_options.threads.end(), 0)
+            || std::count(build_options.sizes.begin(), build_options.sizes.end(), 0)) {
+            std::cerr << "Arguments to --" << build_threads.GetMatcher().GetLongOrAny().str() << " and --"
+                      << sizes.GetMatcher().GetLongOrAny().str() << " must be positive.";
+            return 1;
+        }
+        build_options.repetitions = repetitions ? std::max<size_t>(repetitions.Get(), 1) : 3;
+    }
+
     global_verbose = verbose.Get();
-    std::cout << "dataset,class_name,build_ms,bytes,query_ns" << std::endl;
+    if (options.format == "json")
+        global_verbose_stream = &std::cerr;
+
+    ResultWriter writer(options, collect_metadata(options, argc, argv));
+    if (modes.build)
+        writer.start(build_csv_header());
+    else if (modes.mapped)
+        writer.start(mapped_csv_header());
+    else if (modes.dynamic)
+        writer.start(dynamic_csv_header());
+    else
+        writer.start(csv_header(options));
 
     if (synthetic) {
         auto record_size = value_size.Get() + sizeof(uint64_t);
@@ -109,9 +468,9 @@ int main(int argc, char **argv) {
             std::vector<uint64_t> out(n);
             std::generate(out.begin(), out.end(), [&] { return distribution(generator); });
             std::sort(out.begin(), out.end());
-            return to_records(out, record_size);
+            return out;
         };
-        std::vector<std::pair<std::string, std::function<std::vector<char>()>>> distributions = {
+        std::vector<std::pair<std::string, std::function<std::vector<uint64_t>()>>> distributions = {
             {"uniform_dense", std::bind(gen, std::uniform_int_distribution<uint64_t>(0, n * 1000))},
             {"uniform_sparse", std::bind(gen, std::uniform_int_distribution<uint64_t>(0, n * n))},
             {"binomial", std::bind(gen, std::binomial_distribution<uint64_t>(1ull << 50))},
@@ -121,13 +480,14 @@ int main(int argc, char **argv) {
         OUT_VERBOSE("Generating " << to_metric(n) << " elements (8-byte keys + " << value_size.Get() << "-byte values)")
         OUT_VERBOSE("Total memory for data is " << to_metric(n * record_size, 2, true) << "B")
         for (auto&[name, gen_data] : distributions)
-            benchmark_all<uint64_t, ALL_CLASSES(uint64_t)>(name, gen_data(), record_size, ratio.Get(), workload.Get());
+            benchmark_dataset(name, gen_data(), record_size, options, modes, writer);
     }
 
     if (i64.Get())
-        read_ints_helper<int64_t>(files, value_size.Get() + sizeof(int64_t), ratio.Get(), workload.Get());
+        read_ints_helper<int64_t>(files, value_size.Get() + sizeof(int64_t), options, modes, writer);
     if (u64.Get())
-        read_ints_helper<uint64_t>(files, value_size.Get() + sizeof(uint64_t), ratio.Get(), workload.Get());
+        read_ints_helper<uint64_t>(files, value_size.Get() + sizeof(uint64_t), options, modes, writer);
 
+    writer.finish();
     return 0;
 }
\ No newline at end of file
@@ -15,8 +15,11 @@
 
 #pragma once
 
+#include "perf_counters.hpp"
+
 #include <sys/stat.h>
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <chrono>
 #include <cmath>
@@ -25,20 +28,39 @@
 #include <fstream>
 #include <iostream>
 #include <iterator>
+#include <limits>
+#include <numeric>
+#include <optional>
 #include <random>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <tuple>
 #include <type_traits>
 #include <vector>
 
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
 bool global_verbose = false;
+std::ostream *global_verbose_stream = &std::cout; ///< Where verbose messages go, as comment lines.
 
 #define IF_VERBOSE(X) if (global_verbose) { X; }
-#define OUT_VERBOSE(X) if (global_verbose) { std::cout << "# " << X << std::endl; }
+#define OUT_VERBOSE(X) if (global_verbose) { *global_verbose_stream << "# " << X << std::endl; }
 
 using timer = std::chrono::high_resolution_clock;
 
+inline std::vector<std::string> split(const std::string &s, char delimiter) {
+    std::vector<std::string> out;
+    std::stringstream ss(s);
+    for (std::string item; std::getline(ss, item, delimiter);)
+        if (!item.empty())
+            out.push_back(item);
+    return out;
+}
+
 template<typename T>
 std::string to_metric(const T &x, int digits = 2, bool space = false) {
     static const char *prefix[] = {"y", "z", "a", "f", "p", "n", "µ", "m", "", "k", "M", "G", "T", "P", "E", "Z", "Y"};
@@ -205,27 +227,356 @@ public:
     bool operator==(const RecordIterator &it) const { return *this - it == 0; }
 };
 
-template<typename Class, typename RandomIt>
-std::tuple<uint64_t, uint64_t, size_t>
-benchmark(RandomIt begin, RandomIt end, const std::vector<typename RandomIt::value_type> &queries) {
+/**
+ * A histogram of latencies in nanoseconds, with logarithmic buckets each split into linear sub-buckets as in
+ * HdrHistogram, so that any recorded value is reported with a relative error below 2^-sub_bucket_bits.
+ */
+class LatencyHistogram {
+    static constexpr int sub_bucket_bits = 5;
+    static constexpr uint64_t sub_buckets = 1ull << sub_bucket_bits;
+
+    std::vector<uint64_t> counts;
+    uint64_t total = 0;
+    uint64_t max = 0;
+
+    static size_t index_of(uint64_t value) {
+        if (value < sub_buckets)
+            return value;
+        auto shift = 63 - __builtin_clzll(value) - sub_bucket_bits;
+        return ((shift + 1) << sub_bucket_bits) + (value >> shift) - sub_buckets;
+    }
+
+    /** Returns the midpoint of the range of values counted by the bucket at the given index. */
+    static uint64_t value_of(size_t index) {
+        if (index < sub_buckets)
+            return index;
+        auto shift = (index >> sub_bucket_bits) - 1;
+        auto lower = (sub_buckets + (index & (sub_buckets - 1))) << shift;
+        return lower + ((1ull << shift) >> 1);
+    }
+
+public:
+
+    LatencyHistogram() : counts((65 - sub_bucket_bits) << sub_bucket_bits) {}
+
+    void record(uint64_t value) {
+        ++counts[index_of(value)];
+        ++total;
+        max = std::max(max, value);
+    }
+
+    void merge(const LatencyHistogram &other) {
+        for (size_t i = 0; i < counts.size(); ++i)
+            counts[i] += other.counts[i];
+        total += other.total;
+        max = std::max(max, other.max);
+    }
+
+    /** Returns the value below which the given percentage (in [0, 100]) of the recorded values lie. */
+    uint64_t percentile(double p) const {
+        if (total == 0)
+            return 0;
+        auto rank = std::max<uint64_t>(1, std::ceil(p / 100. * total));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); ++i)
+            if ((seen += counts[i]) >= rank)
+                return std::min(value_of(i), max);
+        return max;
+    }
+
+    uint64_t max_value() const { return max; }
+    uint64_t count() const { return total; }
+};
+
+/**
+ * Returns the median overhead in nanoseconds of reading the timer twice, to be subtracted from timed intervals.
+ */
+inline uint64_t timer_overhead_ns() {
+    static const uint64_t overhead = [] {
+        std::vector<uint64_t> samples(10000);
+        for (auto &s : samples) {
+            auto t0 = timer::now();
+            auto t1 = timer::now();
+            s = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+        }
+        std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+        return samples[samples.size() / 2];
+    }();
+    return overhead;
+}
+
+/** The options of a benchmark run, shared by all the classes and datasets. */
+struct BenchmarkOptions {
+    double lookup_ratio = 0.333; ///< The fraction of generated queries that are lookups of existing keys.
+    std::string workload;        ///< A file with custom queries, overrides lookup_ratio if not empty.
+    std::vector<std::string> distributions = {"uniform"}; ///< The distributions of the generated queries.
+    double zipf_skew = 0.99;     ///< The exponent of the "zipf" distribution.
+    double window = 0.01;        ///< The width of the hot window of the "window" distribution, as a fraction of keys.
+    size_t batch_size = 1000;    ///< The size of the sorted batches of the "sorted" distribution.
+    double scan_length = 100;    ///< The mean number of keys read by a query of the "scan" distribution.
+    size_t threads = 1;          ///< The number of threads that run the queries concurrently on the same index.
+    size_t latency_sample = 0;   ///< If > 0, the latency of every latency_sample-th query is recorded.
+    bool counters = false;       ///< Whether to read the hardware performance counters in the build and query phases.
+    std::vector<size_t> epsilons = {8, 16, 32, 64, 128, 256, 512, 1024}; ///< The values of ε of the runtime variants.
+    std::vector<std::string> variants = {"pgm", "bucketing", "ef", "compressed", "baselines"}; ///< The classes to run.
+    size_t repetitions = 1;      ///< The number of times the queries are run on each index.
+    std::string format = "csv";  ///< The format of the output, either "csv" or "json".
+};
+
+/**
+ * A sequence of queries. If scan_lengths is not empty, the ith query is a range scan that reads scan_lengths[i]
+ * consecutive keys starting from the first key not less than keys[i], otherwise each query is a point lookup.
+ */
+template<typename K>
+struct Workload {
+    std::string distribution;
+    std::vector<K> keys;
+    std::vector<uint32_t> scan_lengths;
+
+    size_t size() const { return keys.size(); }
+};
+
+/** The measurements of a benchmark run of a class. */
+struct BenchmarkResult {
+    uint64_t build_ms;         ///< The time to build the index, in milliseconds.
+    uint64_t query_ns;         ///< The mean time of a query, as seen by each thread, in nanoseconds.
+    size_t bytes;              ///< The size of the index in bytes.
+    size_t threads;            ///< The number of threads that ran the queries.
+    double queries_per_sec;    ///< The aggregate throughput of all the threads.
+    LatencyHistogram latency;  ///< The latencies of the sampled queries of all the threads.
+    size_t keys;               ///< The number of keys the index was built on.
+    size_t queries;            ///< The number of queries run by all the threads.
+    PerfCounters::values_type build_counters; ///< The performance counters of the build phase, of all the threads.
+    PerfCounters::values_type query_counters; ///< The performance counters of the query phase, of all the threads.
+    double query_ns_stddev;    ///< The sample standard deviation of query_ns across the repetitions.
+    size_t repetitions;        ///< The number of times the queries were run.
+};
+
+/** A named value of a result, and whether it is a string rather than a number. An empty value is a missing one. */
+struct ResultField {
+    std::string name;
+    std::string value;
+    bool is_string = false;
+};
+
+/** Returns the fields of a result, in the order of the columns of the CSV output. */
+inline std::vector<ResultField> result_fields(const std::string &dataset, const std::string &distribution,
+                                              const std::string &class_name, const BenchmarkResult &r,
+                                              const BenchmarkOptions &options) {
+    auto number = [](auto x) {
+        std::ostringstream ss;
+        ss << x;
+        return ss.str();
+    };
+    std::vector<ResultField> fields = {
+        {"dataset", dataset, true},
+        {"distribution", distribution, true},
+        {"class_name", class_name, true},
+        {"build_ms", number(r.build_ms)},
+        {"bytes", number(r.bytes)},
+        {"query_ns", number(r.query_ns)},
+        {"threads", number(r.threads)},
+        {"queries_per_sec", number(uint64_t(r.queries_per_sec))},
+        {"query_ns_stddev", number(r.query_ns_stddev)},
+        {"repetitions", number(r.repetitions)},
+    };
+    if (options.latency_sample) {
+        fields.push_back({"p50_ns", number(r.latency.percentile(50))});
+        fields.push_back({"p90_ns", number(r.latency.percentile(90))});
+        fields.push_back({"p99_ns", number(r.latency.percentile(99))});
+        fields.push_back({"p999_ns", number(r.latency.percentile(99.9))});
+        fields.push_back({"max_ns", number(r.latency.max_value())});
+    }
+    if (options.counters) {
+        for (size_t i = 0; i < PerfCounters::count; ++i) {
+            auto v = r.build_counters[i];
+            fields.push_back({std::string("build_") + PerfCounters::names[i] + "_per_key",
+                              v >= 0 ? number(double(v) / r.keys) : ""});
+        }
+        for (size_t i = 0; i < PerfCounters::count; ++i) {
+            auto v = r.query_counters[i];
+            fields.push_back({std::string(PerfCounters::names[i]) + "_per_query",
+                              v >= 0 ? number(double(v) / r.queries) : ""});
+        }
+    }
+    return fields;
+}
+
+/** Returns the header of the CSV output for the given options. */
+inline std::string csv_header(const BenchmarkOptions &options) {
+    std::string header;
+    for (auto &f : result_fields("", "", "", BenchmarkResult{}, options))
+        header += (header.empty() ? "" : ",") + f.name;
+    return header;
+}
+
+/** Prints a line of the CSV output with the given result. */
+inline void print_csv_row(const std::string &dataset, const std::string &distribution, const std::string &class_name,
+                          const BenchmarkResult &r, const BenchmarkOptions &options) {
+    auto first = true;
+    for (auto &f : result_fields(dataset, distribution, class_name, r, options)) {
+        std::cout << (first ? "" : ",");
+        if (f.is_string && f.value.find(',') != std::string::npos)
+            std::cout << '"' << f.value << '"';
+        else
+            std::cout << f.value;
+        first = false;
+    }
+    std::cout << std::endl;
+}
+
+/**
+ * Pins the calling thread to the given CPU, if supported by the platform.
+ */
+inline void pin_thread(size_t cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % CPU_SETSIZE, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+/**
+ * Runs f(i) on each of the given number of threads, each pinned to its own CPU, starting them together.
+ * @return the elapsed time of each thread, in nanoseconds
+ */
+template<typename F>
+std::vector<uint64_t> run_pinned_threads(size_t threads, F f) {
+    std::vector<uint64_t> elapsed_ns(threads);
+    std::vector<std::thread> pool;
+    std::atomic<size_t> ready{0};
+    auto cpus = std::max(1u, std::thread::hardware_concurrency());
+
+    for (size_t i = 0; i < threads; ++i) {
+        pool.emplace_back([&, i] {
+            pin_thread(i % cpus);
+            ++ready;
+            while (ready.load() < threads)
+                std::this_thread::yield();
+            auto t0 = timer::now();
+            f(i);
+            auto t1 = timer::now();
+            elapsed_ns[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+        });
+    }
+
+    for (auto &t : pool)
+        t.join();
+    return elapsed_ns;
+}
+
+/**
+ * Builds an index of type Class on the keys in [begin, end), passing @p args to its constructor after the range, and
+ * runs the given workload on it.
+ */
+template<typename Class, typename RandomIt, typename... Args>
+BenchmarkResult benchmark(RandomIt begin, RandomIt end, const Workload<typename RandomIt::value_type> &workload,
+                          const BenchmarkOptions &options, Args... args) {
+    PerfCounters::values_type build_counters;
+    build_counters.fill(-1);
+    std::optional<TeamPerfCounters> counters;
+    if (options.counters)
+        counters.emplace();
+
+    if (counters)
+        counters->start();
     auto t0 = timer::now();
-    Class index(begin, end);
+    Class index(begin, end, args...);
     auto t1 = timer::now();
     auto build_ms = std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count();
-
-    auto t2 = timer::now();
-    uint64_t cnt = 0;
-    for (auto &q : queries) {
+    if (counters)
+        build_counters = counters->stop();
+
+    // Each thread runs all the queries, starting from a different offset so that threads do not proceed in lockstep
+    auto threads = std::max<size_t>(options.threads, 1);
+    auto sample = options.latency_sample;
+    auto overhead_ns = sample ? timer_overhead_ns() : 0;
+    std::vector<LatencyHistogram> histograms(sample ? threads : 0);
+    std::vector<PerfCounters::values_type> thread_counters(threads);
+    auto &queries = workload.keys;
+    auto scans = !workload.scan_lengths.empty();
+    auto query = [&](size_t i) -> uint64_t {
+        auto &q = queries[i];
         auto range = index.search(q);
         auto lo = begin + range.lo;
         auto hi = begin + range.hi;
-        cnt += std::distance(begin, std::lower_bound(lo, hi, q));
+        auto it = std::lower_bound(lo, hi, q);
+        if (!scans)
+            return std::distance(begin, it);
+        uint64_t sum = 0;
+        for (auto scan_end = it + std::min<size_t>(workload.scan_lengths[i], end - it); it != scan_end; ++it)
+            sum += *it;
+        return sum;
+    };
+    auto query_loop = [&](size_t thread_id) {
+        uint64_t cnt = 0;
+        auto offset = queries.size() * thread_id / threads;
+        thread_counters[thread_id].fill(-1);
+        std::optional<PerfCounters> counters;
+        if (options.counters) {
+            counters.emplace();
+            counters->start();
+        }
+        if (sample == 0) {
+            for (size_t i = 0; i < queries.size(); ++i)
+                cnt += query((offset + i) % queries.size());
+        } else {
+            auto &histogram = histograms[thread_id];
+            for (size_t i = 0; i < queries.size(); ++i) {
+                auto q = (offset + i) % queries.size();
+                if (i % sample != 0) {
+                    cnt += query(q);
+                    continue;
+                }
+                auto t = timer::now();
+                cnt += query(q);
+                auto ns = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(timer::now() - t).count());
+                histogram.record(ns > overhead_ns ? ns - overhead_ns : 0);
+            }
+        }
+        if (counters)
+            thread_counters[thread_id] = counters->stop();
+        [[maybe_unused]] volatile auto tmp = cnt;
+    };
+
+    // Each repetition gives a sample of the mean query time, the counters are those of the last repetition
+    auto repetitions = std::max<size_t>(options.repetitions, 1);
+    std::vector<double> query_ns_samples;
+    double queries_per_sec = 0;
+    for (size_t rep = 0; rep < repetitions; ++rep) {
+        std::vector<uint64_t> elapsed_ns;
+        if (threads == 1) {
+            auto t2 = timer::now();
+            query_loop(0);
+            auto t3 = timer::now();
+            elapsed_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(t3 - t2).count());
+        } else
+            elapsed_ns = run_pinned_threads(threads, query_loop);
+
+        auto total_ns = std::accumulate(elapsed_ns.begin(), elapsed_ns.end(), uint64_t(0));
+        auto max_ns = *std::max_element(elapsed_ns.begin(), elapsed_ns.end());
+        query_ns_samples.push_back(double(total_ns) / (threads * queries.size()));
+        queries_per_sec += threads * queries.size() / (max_ns / 1e9) / repetitions;
     }
-    [[maybe_unused]] volatile auto tmp = cnt;
-    auto t3 = timer::now();
-    auto query_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t3 - t2).count() / queries.size();
 
-    return {build_ms, query_ns, index.size_in_bytes()};
+    auto mean_ns = std::accumulate(query_ns_samples.begin(), query_ns_samples.end(), 0.) / repetitions;
+    auto var_ns = 0.;
+    for (auto x : query_ns_samples)
+        var_ns += (x - mean_ns) * (x - mean_ns) / std::max<size_t>(repetitions - 1, 1);
+
+    LatencyHistogram latency;
+    for (auto &h : histograms)
+        latency.merge(h);
+
+    PerfCounters::values_type query_counters;
+    query_counters.fill(-1);
+    for (auto &c : thread_counters)
+        PerfCounters::accumulate(query_counters, c);
+
+    return {uint64_t(build_ms), uint64_t(mean_ns), index.size_in_bytes(), threads, queries_per_sec, latency,
+            size_t(std::distance(begin, end)), threads * queries.size(), build_counters, query_counters,
+            std::sqrt(var_ns), repetitions};
 }
 
 template<typename RandomIt>
@@ -250,34 +601,129 @@ generate_queries(RandomIt first, RandomIt last, double lookup_ratio, size_t max_
     return queries;
 }
 
+/**
+ * A generator of integers in [1, n] with probability proportional to 1/k^s, which uses the rejection-inversion method
+ * of W. Hörmann and G. Derflinger, "Rejection-inversion to generate variates from monotone discrete distributions",
+ * ACM TOMACS, 1996, and hence takes constant time and space for any n.
+ */
+class ZipfDistribution {
+    double exponent;
+    double h_integral_x1;
+    double h_integral_n;
+    double s;
+    uint64_t n;
+
+    double h(double x) const { return std::exp(-exponent * std::log(x)); }
+
+    double h_integral(double x) const {
+        auto log_x = std::log(x);
+        auto t = (1 - exponent) * log_x;
+        return (std::abs(t) > 1e-8 ? std::expm1(t) / t : 1 + t / 2) * log_x;
+    }
+
+    double h_integral_inverse(double x) const {
+        auto t = std::max(-1., x * (1 - exponent));
+        return std::exp((std::abs(t) > 1e-8 ? std::log1p(t) / t : 1 - t / 2) * x);
+    }
+
+public:
+
+    ZipfDistribution(uint64_t n, double exponent)
+        : exponent(exponent),
+          h_integral_x1(h_integral(1.5) - 1),
+          h_integral_n(h_integral(n + 0.5)),
+          s(2 - h_integral_inverse(h_integral(2.5) - h(2))),
+          n(n) {}
+
+    template<typename Generator>
+    uint64_t operator()(Generator &generator) {
+        std::uniform_real_distribution<double> uniform(0, 1);
+        while (true) {
+            auto u = h_integral_n + uniform(generator) * (h_integral_x1 - h_integral_n);
+            auto x = h_integral_inverse(u);
+            auto k = std::clamp<uint64_t>(uint64_t(x + 0.5), 1, n);
+            if (k - x <= s || u >= h_integral(k + 0.5) - h(k))
+                return k;
+        }
+    }
+};
+
+/**
+ * Generates a workload of queries on the keys in [first, last) with the given distribution, among:
+ *  - "uniform": lookups at uniformly random positions and keys uniformly random in [*first, *(last-1)];
+ *  - "zipf": lookups of keys whose popularity follows a Zipf law, with the hot keys scattered over the data;
+ *  - "window": lookups at uniformly random positions in a window that slides from the first to the last key, as in
+ *    time series where the recent keys are the hottest;
+ *  - "sorted": uniform queries sorted in batches, as in bulk lookups from a sorted source;
+ *  - "scan": range scans from a uniformly random position, of geometrically distributed length.
+ * In all but "uniform" and "scan", a fraction 1 - lookup_ratio of the queries are keys that are likely not present,
+ * obtained by incrementing the looked up key.
+ */
+template<typename RandomIt>
+Workload<typename RandomIt::value_type> generate_workload(RandomIt first, RandomIt last, const std::string &distribution,
+                                                          const BenchmarkOptions &options,
+                                                          size_t max_queries = 10000000) {
+    using value_type = typename RandomIt::value_type;
+    Workload<value_type> workload{distribution, {}, {}};
+    if (distribution == "uniform" || distribution == "sorted") {
+        workload.keys = generate_queries(first, last, options.lookup_ratio, max_queries);
+        if (distribution == "sorted")
+            for (auto it = workload.keys.begin(); it < workload.keys.end(); it += options.batch_size)
+                std::sort(it, std::min(workload.keys.end(), it + options.batch_size));
+        return workload;
+    }
+
+    auto n = size_t(std::distance(first, last));
+    auto num_queries = std::min<size_t>(n / 10, max_queries);
+    std::mt19937_64 generator(std::random_device{}());
+    std::bernoulli_distribution is_lookup(options.lookup_ratio);
+    auto make_query = [&](size_t pos) {
+        auto key = first[pos];
+        return is_lookup(generator) || key == std::numeric_limits<value_type>::max() ? key : value_type(key + 1);
+    };
+    workload.keys.reserve(num_queries);
+
+    if (distribution == "zipf") {
+        ZipfDistribution zipf(n, options.zipf_skew);
+        for (size_t i = 0; i < num_queries; ++i)
+            workload.keys.push_back(make_query((zipf(generator) - 1) * 0x9E3779B97F4A7C15ull % n));
+    } else if (distribution == "window") {
+        auto width = std::clamp<size_t>(n * options.window, 1, n);
+        std::uniform_int_distribution<size_t> offset(0, width - 1);
+        for (size_t i = 0; i < num_queries; ++i)
+            workload.keys.push_back(make_query((n - width) * i / num_queries + offset(generator)));
+    } else if (distribution == "scan") {
+        std::uniform_int_distribution<size_t> pos_distribution(0, n - 1);
+        std::geometric_distribution<uint32_t> length(1 / std::max(1., options.scan_length));
+        for (size_t i = 0; i < num_queries; ++i) {
+            workload.keys.push_back(first[pos_distribution(generator)]);
+            workload.scan_lengths.push_back(1 + length(generator));
+        }
+    } else
+        throw std::invalid_argument("Unknown query distribution " + distribution);
+
+    return workload;
+}
+
 template<typename T>
 struct type_wrapper { using type = T; };
 
 template<typename... Ts, typename TF>
 void for_types(TF &&f) { (f(type_wrapper<Ts>{}), ...); }
 
-template<typename K, typename... Args>
-void benchmark_all(const std::string &filename,
-                   const std::vector<char> &data,
-                   size_t record_size,
-                   double lookup_ratio,
-                   const std::string &workload) {
-    auto begin = RecordIterator<K>(data.data(), record_size);
-    auto end = RecordIterator<K>(data.data() + data.size(), record_size);
-
-    std::vector<K> queries;
-    if (!workload.empty())
-        queries = read_data_binary<K>(workload, false);
+/** Returns the custom workload or the generated workloads of each distribution in the options. */
+template<typename K>
+std::vector<Workload<K>> generate_workloads(RecordIterator<K> begin, RecordIterator<K> end,
+                                            const BenchmarkOptions &options) {
+    std::vector<Workload<K>> workloads;
+    if (!options.workload.empty())
+        workloads.push_back({"custom", read_data_binary<K>(options.workload, false), {}});
     else {
-        queries = generate_queries(begin, end, lookup_ratio);
-        auto m = queries.size();
-        OUT_VERBOSE("Generated " << to_metric(m) << " queries, " << to_metric(m * lookup_ratio) << " are lookups")
+        for (auto &distribution : options.distributions) {
+            workloads.push_back(generate_workload(begin, end, distribution, options));
+            auto m = workloads.back().size();
+            OUT_VERBOSE("Generated " << to_metric(m) << " " << distribution << " queries")
+        }
     }
-
-    for_types<Args...>([&](auto t) {
-        using class_type = typename decltype(t)::type;
-        auto name = demangle(typeid(class_type).name());
-        auto[build_ms, query_ns, bytes] = benchmark<class_type>(begin, end, queries);
-        std::cout << filename << ",\"" << name << "\"," << build_ms << "," << bytes << "," << query_ns << std::endl;
-    });
+    return workloads;
 }
\ No newline at end of file
@@ -0,0 +1,235 @@
+// This file is part of PGM-index <https://github.com/gvinciguerra/PGM-index>.
+// Copyright (c) 2021 Giorgio Vinciguerra.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "benchmark.hpp"
+#include "pgm/pgm_index_dynamic.hpp"
+
+#include <fstream>
+#include <sstream>
+
+/**
+ * The fractions of the operations of a dynamic workload, in the spirit of the YCSB core workloads.
+ */
+struct OperationMix {
+    std::string name;
+    double insert = 0;  ///< Insertions of new keys.
+    double update = 0;  ///< Updates of the value of existing keys.
+    double erase = 0;   ///< Deletions of existing keys.
+    double find = 0;    ///< Point lookups.
+    double scan = 0;    ///< Short range scans.
+    double rmw = 0;     ///< Lookups followed by an update of the same key.
+    bool latest = false; ///< Whether lookups favour the most recently inserted keys rather than the popular ones.
+
+    /**
+     * Returns the mix corresponding to one of the YCSB workloads "a" to "f", or a custom mix given as
+     * "insert:update:erase:find:scan" percentages.
+     */
+    static OperationMix parse(const std::string &s) {
+        if (s == "a") return {"a", 0, .5, 0, .5, 0, 0, false};
+        if (s == "b") return {"b", 0, .05, 0, .95, 0, 0, false};
+        if (s == "c") return {"c", 0, 0, 0, 1, 0, 0, false};
+        if (s == "d") return {"d", .05, 0, 0, .95, 0, 0, true};
+        if (s == "e") return {"e", .05, 0, 0, 0, .95, 0, false};
+        if (s == "f") return {"f", 0, 0, 0, .5, 0, .5, false};
+
+        std::vector<double> fractions;
+        std::stringstream ss(s);
+        for (std::string item; std::getline(ss, item, ':');)
+            fractions.push_back(std::stod(item));
+        auto sum = std::accumulate(fractions.begin(), fractions.end(), 0.);
+        if (fractions.size() != 5 || sum <= 0)
+            throw std::invalid_argument("Invalid operation mix " + s);
+        for (auto &f : fractions)
+            f /= sum;
+        return {s, fractions[0], fractions[1], fractions[2], fractions[3], fractions[4], 0, false};
+    }
+};
+
+/** The options of the dynamic benchmark. */
+struct DynamicBenchmarkOptions {
+    std::vector<OperationMix> mixes;
+    std::vector<uint8_t> bases = {4, 8, 16};
+    std::vector<uint8_t> buffer_levels = {0};
+    std::vector<uint8_t> index_levels = {0};
+    double load_fraction = 0.5; ///< The fraction of the keys bulk loaded before running the operations.
+    size_t max_scan_length = 100;
+};
+
+/** Returns the peak resident set size of the process in bytes, after resetting it if @p reset is true (Linux only). */
+inline size_t peak_rss_bytes(bool reset = false) {
+#ifdef __linux__
+    if (reset)
+        std::ofstream("/proc/self/clear_refs") << "5";
+    std::ifstream status("/proc/self/status");
+    for (std::string line; std::getline(status, line);)
+        if (line.rfind("VmHWM:", 0) == 0)
+            return std::stoull(line.substr(6)) * 1024;
+#endif
+    return 0;
+}
+
+template<typename K>
+struct DynamicOperation {
+    enum Type : uint8_t { Insert, Update, Erase, Find, Scan, ReadModifyWrite } type;
+    uint32_t length; ///< The number of keys read by a scan.
+    K key;
+};
+
+/**
+ * Generates the operations of a dynamic workload. The keys to insert are taken in order from @p new_keys, and the
+ * other operations target the keys in @p loaded_keys with a Zipf distribution, or the most recently inserted keys if
+ * the mix says so.
+ */
+template<typename K>
+std::vector<DynamicOperation<K>> generate_operations(const std::vector<K> &loaded_keys, const std::vector<K> &new_keys,
+                                                     const OperationMix &mix, size_t count,
+                                                     const BenchmarkOptions &options,
+                                                     const DynamicBenchmarkOptions &dyn_options) {
+    using op = DynamicOperation<K>;
+    std::mt19937_64 generator(std::random_device{}());
+    std::discrete_distribution<int> type({mix.insert, mix.update, mix.erase, mix.find, mix.scan, mix.rmw});
+    std::uniform_int_distribution<uint32_t> length(1, dyn_options.max_scan_length);
+    ZipfDistribution popular(loaded_keys.size(), options.zipf_skew);
+    ZipfDistribution recent(std::max<size_t>(new_keys.size(), 1), options.zipf_skew);
+    size_t inserted = 0;
+
+    auto popular_key = [&] { return loaded_keys[(popular(generator) - 1) * 0x9E3779B97F4A7C15ull % loaded_keys.size()]; };
+    auto read_key = [&] {
+        if (!mix.latest || inserted == 0)
+            return popular_key();
+        auto r = recent(generator);
+        return r <= inserted ? new_keys[inserted - r] : popular_key();
+    };
+
+    std::vector<op> operations;
+    operations.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        auto t = typename op::Type(type(generator));
+        if (t == op::Insert && inserted == new_keys.size())
+            t = op::Update;
+        switch (t) {
+            case op::Insert: operations.push_back({t, 0, new_keys[inserted++]}); break;
+            case op::Scan: operations.push_back({t, length(generator), read_key()}); break;
+            case op::Update:
+            case op::Erase: operations.push_back({t, 0, popular_key()}); break;
+            default: operations.push_back({t, 0, read_key()}); break;
+        }
+    }
+    return operations;
+}
+
+/** Runs the given operation on the index, and adds the values it reads to @p cnt so that they are not optimised away. */
+template<typename Index, typename K>
+void run_operation(Index &index, const DynamicOperation<K> &o, uint64_t &cnt) {
+    using op = DynamicOperation<K>;
+    switch (o.type) {
+        case op::Insert:
+        case op::Update: index.insert_or_assign(o.key, cnt); break;
+        case op::Erase: index.erase(o.key); break;
+        case op::Find: cnt += index.find(o.key) != index.end(); break;
+        case op::Scan: {
+            auto it = index.lower_bound(o.key);
+            for (uint32_t j = 0; j < o.length && it != index.end(); ++j, ++it)
+                cnt += it->second;
+            break;
+        }
+        case op::ReadModifyWrite: {
+            auto it = index.find(o.key);
+            index.insert_or_assign(o.key, it == index.end() ? 0 : it->second + 1);
+            break;
+        }
+    }
+}
+
+/**
+ * Runs each operation mix on a DynamicPGMIndex for each combination of base, buffer_level and index_level, and prints
+ * a CSV line with the throughput, the latency percentiles, the peak memory and the time spent merging the levels.
+ */
+template<typename K>
+void benchmark_dynamic(const std::string &dataset, std::vector<K> keys, const BenchmarkOptions &options,
+                       const DynamicBenchmarkOptions &dyn_options) {
+    using dynamic_pgm_type = pgm::DynamicPGMIndex<K, uint64_t>;
+    using op = DynamicOperation<K>;
+
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    std::shuffle(keys.begin(), keys.end(), std::mt19937_64(42));
+    auto load_size = std::max<size_t>(1, keys.size() * dyn_options.load_fraction);
+    std::vector<K> new_keys(keys.begin() + load_size, keys.end());
+    keys.resize(load_size);
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<std::pair<K, uint64_t>> loaded(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i)
+        loaded[i] = {keys[i], i};
+
+    // Timing every operation would add the overhead of the timer to the throughput, so the latency is always sampled
+    auto sample = options.latency_sample ? options.latency_sample : 64;
+    auto overhead_ns = timer_overhead_ns();
+    auto count = std::min<size_t>(keys.size() + new_keys.size(), 10000000);
+
+    for (auto &mix : dyn_options.mixes) {
+        auto operations = generate_operations(keys, new_keys, mix, count, options, dyn_options);
+        for (auto base : dyn_options.bases) {
+            for (auto buffer_level : dyn_options.buffer_levels) {
+                for (auto index_level : dyn_options.index_levels) {
+                    dynamic_pgm_type index(loaded.begin(), loaded.end(), base, buffer_level, index_level);
+                    auto rss_before = peak_rss_bytes(true);
+                    auto merges_before = index.merge_stats();
+                    LatencyHistogram latency;
+                    size_t peak_bytes = index.size_in_bytes();
+                    uint64_t cnt = 0;
+                    auto run = [&](const op &o) { run_operation(index, o, cnt); };
+
+                    auto t0 = timer::now();
+                    for (size_t i = 0; i < operations.size(); ++i) {
+                        if (i % sample != 0) {
+                            run(operations[i]);
+                            continue;
+                        }
+                        auto t = timer::now();
+                        run(operations[i]);
+                        auto ns = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(timer::now() - t).count());
+                        latency.record(ns > overhead_ns ? ns - overhead_ns : 0);
+                        if (i % (1024 * sample) == 0)
+                            peak_bytes = std::max(peak_bytes, index.size_in_bytes());
+                    }
+                    auto t1 = timer::now();
+                    [[maybe_unused]] volatile auto tmp = cnt;
+
+                    auto elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+                    auto rss_after = peak_rss_bytes();
+                    auto merges = index.merge_stats().merges - merges_before.merges;
+                    auto merge_ns = index.merge_stats().nanoseconds - merges_before.nanoseconds;
+                    std::cout << dataset << "," << mix.name << "," << int(base) << "," << int(buffer_level) << ","
+                              << int(index_level) << "," << operations.size() << ","
+                              << uint64_t(operations.size() / (elapsed_ns / 1e9));
+                    for (auto p : {50., 90., 99., 99.9})
+                        std::cout << "," << latency.percentile(p);
+                    std::cout << "," << latency.max_value() << "," << std::max(peak_bytes, index.size_in_bytes())
+                              << "," << (rss_after > rss_before ? rss_after - rss_before : 0) << ","
+                              << merges << "," << merge_ns / 1000000 << "," << double(merge_ns) / elapsed_ns
+                              << std::endl;
+                }
+            }
+        }
+    }
+}
+
+inline std::string dynamic_csv_header() {
+    return "dataset,mix,base,buffer_level,index_level,operations,ops_per_sec,p50_ns,p90_ns,p99_ns,p999_ns,max_ns,"
+           "peak_bytes,peak_rss_delta_bytes,merges,merge_ms,merge_time_fraction";
+}
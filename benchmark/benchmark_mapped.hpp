@@ -0,0 +1,198 @@
+// This file is part of PGM-index <https://github.com/gvinciguerra/PGM-index>.
+// Copyright (c) 2021 Giorgio Vinciguerra.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "benchmark.hpp"
+#include "mock_pgm_index.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/** The options of the benchmark of MappedPGMIndex. */
+struct MappedBenchmarkOptions {
+    std::string directory = ".";  ///< Where to write the files backing the indexes.
+    size_t cold_queries = 10000;  ///< The number of queries run right after evicting the file from the page cache.
+    bool readahead = false;       ///< Whether to keep the kernel readahead on the mapping, which hides the cost of a query.
+};
+
+/** The page faults and the bytes read from storage by the process, at some point in time. */
+struct IoSnapshot {
+    int64_t minor_faults;
+    int64_t major_faults;
+    int64_t read_bytes; ///< Bytes fetched from the storage layer, or -1 if unknown.
+
+    static IoSnapshot now() {
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        IoSnapshot s{usage.ru_minflt, usage.ru_majflt, -1};
+#ifdef __linux__
+        std::ifstream io("/proc/self/io");
+        for (std::string line; std::getline(io, line);)
+            if (line.rfind("read_bytes:", 0) == 0)
+                s.read_bytes = std::stoll(line.substr(11));
+#endif
+        return s;
+    }
+};
+
+/**
+ * Writes the dirty pages of @p filename to storage and asks the kernel to drop the file from the page cache. Pages that
+ * are currently mapped by some process are not dropped.
+ * @return @c true if the kernel accepted the request
+ */
+inline bool evict_from_page_cache(const std::string &filename) {
+    auto fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+    fdatasync(fd);
+    auto ok = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return ok;
+}
+
+/** Returns the page-aligned range of addresses that contains [first, last). */
+template<typename K>
+std::pair<uintptr_t, size_t> page_span(const K *first, const K *last) {
+    auto page = size_t(sysconf(_SC_PAGESIZE));
+    auto lo = uintptr_t(first) / page * page;
+    auto hi = std::max(uintptr_t(last), lo);
+    return {lo, (hi - lo + page - 1) / page * page};
+}
+
+/** Returns the fraction of the pages in [first, last) that are in the page cache. */
+template<typename K>
+double resident_fraction(const K *first, const K *last) {
+    auto page = size_t(sysconf(_SC_PAGESIZE));
+    auto[lo, bytes] = page_span(first, last);
+    if (bytes == 0)
+        return 0;
+    std::vector<unsigned char> pages(bytes / page);
+    if (mincore((void *) lo, bytes, pages.data()) != 0)
+        return -1;
+    size_t resident = 0;
+    for (auto p : pages)
+        resident += p & 1;
+    return resident / double(pages.size());
+}
+
+inline std::string mapped_csv_header() {
+    std::string header = "dataset,distribution,class_name,build_ms,bytes,file_bytes,cached_fraction";
+    for (std::string phase : {"cold", "warm"})
+        header += "," + phase + "_queries," + phase + "_query_ns," + phase + "_p50_ns," + phase + "_p99_ns,"
+            + phase + "_minflt_per_query," + phase + "_majflt_per_query," + phase + "_read_bytes_per_query";
+    return header;
+}
+
+/**
+ * Benchmarks MappedPGMIndex for each ε in the options. For each of them, the data is written to a file that is then
+ * evicted from the page cache, so that the first queries (the cold phase) read the data from storage. The remaining
+ * queries run after a warm-up pass over the whole workload (the warm phase).
+ */
+template<typename K>
+void benchmark_mapped(const std::string &dataset, const std::vector<K> &keys, const BenchmarkOptions &options,
+                      const MappedBenchmarkOptions &mapped_options) {
+    std::vector<Workload<K>> workloads;
+    if (!options.workload.empty())
+        workloads.push_back({"custom", read_data_binary<K>(options.workload, false), {}});
+    else
+        for (auto &distribution : options.distributions)
+            workloads.push_back(generate_workload(keys.begin(), keys.end(), distribution, options));
+
+    auto overhead_ns = timer_overhead_ns();
+    // The cold phase times every query, the warm one samples them to keep the timer out of the mean query time
+    auto sample = options.latency_sample ? options.latency_sample : 64;
+
+    for (auto &w : workloads) {
+        for (auto eps : options.epsilons) {
+            auto path = mapped_options.directory + "/pgm_mapped_" + dataset + "_" + std::to_string(eps) + ".bin";
+            auto t0 = timer::now();
+            {
+                MockMappedPGMIndex<K> writer(keys.begin(), keys.end(), path, eps);
+            }
+            auto t1 = timer::now();
+            auto build_ms = std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count();
+
+            // Reopen the file after the eviction, and evict again the pages that reading the header brought in
+            evict_from_page_cache(path);
+            MockMappedPGMIndex<K> index(path, eps);
+            if (!mapped_options.readahead) {
+                auto[lo, bytes] = page_span(index.begin(), index.end());
+                madvise((void *) lo, bytes, MADV_RANDOM);
+            }
+            evict_from_page_cache(path);
+            auto cached = resident_fraction(index.begin(), index.end());
+
+            auto query = [&](size_t i) -> uint64_t {
+                auto it = index.lower_bound(w.keys[i]);
+                if (w.scan_lengths.empty())
+                    return std::distance(index.begin(), it);
+                uint64_t sum = 0;
+                for (auto scan_end = it + std::min<size_t>(w.scan_lengths[i], index.end() - it); it != scan_end; ++it)
+                    sum += *it;
+                return sum;
+            };
+
+            auto run_phase = [&](size_t first, size_t last, size_t every) {
+                LatencyHistogram latency;
+                uint64_t cnt = 0;
+                auto before = IoSnapshot::now();
+                auto t = timer::now();
+                for (size_t i = first; i < last; ++i) {
+                    if ((i - first) % every != 0) {
+                        cnt += query(i);
+                        continue;
+                    }
+                    auto q0 = timer::now();
+                    cnt += query(i);
+                    auto ns = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(timer::now() - q0).count());
+                    latency.record(ns > overhead_ns ? ns - overhead_ns : 0);
+                }
+                auto elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(timer::now() - t).count();
+                auto after = IoSnapshot::now();
+                [[maybe_unused]] volatile auto tmp = cnt;
+
+                auto m = std::max<size_t>(last - first, 1);
+                std::cout << "," << last - first << "," << elapsed_ns / m << "," << latency.percentile(50) << ","
+                          << latency.percentile(99) << "," << double(after.minor_faults - before.minor_faults) / m
+                          << "," << double(after.major_faults - before.major_faults) / m << ",";
+                if (before.read_bytes >= 0 && after.read_bytes >= 0)
+                    std::cout << double(after.read_bytes - before.read_bytes) / m;
+            };
+
+            std::cout << dataset << "," << w.distribution << ",\"pgm::MappedPGMIndex<" << demangle(typeid(K).name())
+                      << ", " << eps << ">\"," << build_ms << "," << index.size_in_bytes() << ","
+                      << index.file_size_in_bytes() << "," << cached;
+
+            auto cold = std::min(mapped_options.cold_queries, w.size());
+            run_phase(0, cold, 1);
+            uint64_t warm_up = 0;
+            for (size_t i = 0; i < w.size(); ++i)
+                warm_up += query(i);
+            [[maybe_unused]] volatile auto tmp = warm_up;
+            run_phase(0, w.size(), sample);
+            std::cout << std::endl;
+
+            std::remove(path.c_str());
+        }
+    }
+}
@@ -0,0 +1,171 @@
+// This file is part of PGM-index <https://github.com/gvinciguerra/PGM-index>.
+// Copyright (c) 2018 Giorgio Vinciguerra.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "pgm/pgm_index.hpp"
+#include "pgm/pgm_index_variants.hpp"
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <vector>
+
+/*
+ * Variants of the PGM-index classes whose Epsilon is given at construction time rather than as a template argument,
+ * so that any value of ε can be tried without recompiling. The template argument of the base class is ignored, except
+ * for EpsilonRecursive, which defaults to PGM_EPSILON_RECURSIVE.
+ */
+
+#define PGM_IGNORED_PARAMETER 1
+#define PGM_EPSILON_RECURSIVE 4
+
+template<typename K, size_t EpsilonRecursive = PGM_EPSILON_RECURSIVE, typename Floating = float>
+class MockPGMIndex : public pgm::PGMIndex<K, PGM_IGNORED_PARAMETER, EpsilonRecursive, Floating> {
+    size_t epsilon;
+
+public:
+
+    using segment_type = typename pgm::PGMIndex<K, PGM_IGNORED_PARAMETER, EpsilonRecursive, Floating>::Segment;
+
+    MockPGMIndex() = default;
+
+    MockPGMIndex(const std::vector<K> &data, size_t epsilon) : MockPGMIndex(data.begin(), data.end(), epsilon) {}
+
+    template<typename RandomIt>
+    MockPGMIndex(RandomIt first, RandomIt last, size_t epsilon) : epsilon(epsilon) {
+        this->n = std::distance(first, last);
+        this->first_key = this->n ? *first : K(0);
+        this->build(first, last, epsilon, EpsilonRecursive, this->segments, this->levels_offsets);
+    }
+
+    pgm::ApproxPos search(const K &key) const {
+        auto k = std::max(this->first_key, key);
+        auto it = this->segment_for_key(k);
+        auto pos = std::min<size_t>((*it)(k), std::next(it)->intercept);
+        auto lo = PGM_SUB_EPS(pos, epsilon);
+        auto hi = PGM_ADD_EPS(pos, epsilon, this->n);
+        return {pos, lo, hi};
+    }
+};
+
+template<typename K, size_t TopLevelSize, typename Floating = float>
+class MockBucketingPGMIndex : public pgm::BucketingPGMIndex<K, PGM_IGNORED_PARAMETER, TopLevelSize, 32, Floating> {
+    size_t epsilon;
+
+public:
+
+    MockBucketingPGMIndex() = default;
+
+    template<typename RandomIt>
+    MockBucketingPGMIndex(RandomIt first, RandomIt last, size_t epsilon) : epsilon(epsilon) {
+        this->n = std::distance(first, last);
+        this->first_key = this->n ? *first : K(0);
+        this->last_key = this->n ? *std::prev(last) : K(0);
+        this->build(first, last, epsilon);
+    }
+
+    pgm::ApproxPos search(const K &key) const {
+        if (__builtin_expect(key < this->first_key, 0))
+            return {0, 0, 0};
+        if (__builtin_expect(key > this->last_key, 0))
+            return {this->n, this->n, this->n};
+        auto it = this->segment_for_key(key);
+        auto pos = std::min<size_t>((*it)(key), std::next(it)->intercept);
+        auto lo = PGM_SUB_EPS(pos, epsilon);
+        auto hi = PGM_ADD_EPS(pos, epsilon, this->n);
+        return {pos, lo, hi};
+    }
+};
+
+template<typename K, typename Floating = float>
+class MockEliasFanoPGMIndex : public pgm::EliasFanoPGMIndex<K, PGM_IGNORED_PARAMETER, Floating> {
+    size_t epsilon;
+
+public:
+
+    MockEliasFanoPGMIndex() = default;
+
+    template<typename RandomIt>
+    MockEliasFanoPGMIndex(RandomIt first, RandomIt last, size_t epsilon) : epsilon(epsilon) {
+        this->n = std::distance(first, last);
+        this->first_key = this->n ? *first : K(0);
+        this->build(first, last, epsilon);
+    }
+
+    pgm::ApproxPos search(const K &key) const {
+        auto k = std::max(this->first_key, key);
+        auto[r, origin] = this->pred(k - this->first_key);
+        auto pos = std::min<size_t>(this->segments[r](origin + this->first_key, k), this->segments[r + 1].intercept);
+        auto lo = PGM_SUB_EPS(pos, epsilon);
+        auto hi = PGM_ADD_EPS(pos, epsilon, this->n);
+        return {pos, lo, hi};
+    }
+};
+
+template<typename K, size_t EpsilonRecursive = PGM_EPSILON_RECURSIVE, typename Floating = float>
+class MockCompressedPGMIndex : public pgm::CompressedPGMIndex<K, PGM_IGNORED_PARAMETER, EpsilonRecursive, Floating> {
+    size_t epsilon;
+
+public:
+
+    MockCompressedPGMIndex() = default;
+
+    template<typename RandomIt>
+    MockCompressedPGMIndex(RandomIt first, RandomIt last, size_t epsilon) : epsilon(epsilon) {
+        this->n = std::distance(first, last);
+        this->build(first, last, epsilon);
+    }
+
+    pgm::ApproxPos search(const K &key) const {
+        auto pos = this->position(key);
+        auto lo = PGM_SUB_EPS(pos, epsilon);
+        auto hi = PGM_ADD_EPS(pos, epsilon, this->n);
+        return {pos, lo, hi};
+    }
+};
+
+template<typename K, typename Floating = float>
+class MockMappedPGMIndex : public pgm::MappedPGMIndex<K, PGM_IGNORED_PARAMETER, PGM_EPSILON_RECURSIVE, Floating> {
+    size_t epsilon;
+
+public:
+
+    template<typename RandomIt>
+    MockMappedPGMIndex(RandomIt first, RandomIt last, const std::string &out_filename, size_t epsilon)
+        : epsilon(epsilon) {
+        this->n = std::distance(first, last);
+        this->first_key = this->n ? *first : K(0);
+        this->build(first, last, epsilon, PGM_EPSILON_RECURSIVE, this->segments, this->levels_offsets);
+        this->serialize_and_map(first, last, out_filename);
+    }
+
+    MockMappedPGMIndex(const std::string &in_filename, size_t epsilon)
+        : pgm::MappedPGMIndex<K, PGM_IGNORED_PARAMETER, PGM_EPSILON_RECURSIVE, Floating>(in_filename),
+          epsilon(epsilon) {}
+
+    pgm::ApproxPos search(const K &key) const {
+        auto k = std::max(this->first_key, key);
+        auto it = this->segment_for_key(k);
+        auto pos = std::min<size_t>((*it)(k), std::next(it)->intercept);
+        auto lo = PGM_SUB_EPS(pos, epsilon);
+        auto hi = PGM_ADD_EPS(pos, epsilon, this->n);
+        return {pos, lo, hi};
+    }
+
+    auto lower_bound(const K &key) const {
+        auto range = search(key);
+        return std::lower_bound(this->begin() + range.lo, this->begin() + range.hi, key);
+    }
+};
@@ -0,0 +1,198 @@
+// This file is part of PGM-index <https://github.com/gvinciguerra/PGM-index>.
+// Copyright (c) 2021 Giorgio Vinciguerra.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * A group of hardware performance counters of the calling thread, read via the Linux perf_event_open interface. See
+ * TeamPerfCounters to count the threads of a parallel region.
+ *
+ * The counters that the kernel or the CPU do not support (e.g., in virtual machines, or when perf_event_paranoid
+ * forbids them) are silently left unavailable. On other platforms, all the counters are unavailable.
+ */
+class PerfCounters {
+public:
+
+    static constexpr size_t count = 6;
+
+    static constexpr std::array<const char *, count> names = {
+        "cycles", "instructions", "l1d_misses", "llc_misses", "dtlb_misses", "branch_misses"
+    };
+
+    /** The values of the counters, or -1 for the unavailable ones. */
+    using values_type = std::array<int64_t, count>;
+
+private:
+
+    std::array<int, count> fds;
+
+#ifdef __linux__
+    static constexpr std::array<std::pair<uint32_t, uint64_t>, count> events = {{
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                             | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                             | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    }};
+
+    int leader() const {
+        for (auto fd : fds)
+            if (fd >= 0)
+                return fd;
+        return -1;
+    }
+#endif
+
+public:
+
+    PerfCounters() {
+        fds.fill(-1);
+#ifdef __linux__
+        for (size_t i = 0; i < count; ++i) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = events[i].first;
+            attr.config = events[i].second;
+            attr.disabled = leader() < 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fds[i] = int(syscall(SYS_perf_event_open, &attr, 0, -1, leader(), 0));
+        }
+#endif
+    }
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    ~PerfCounters() {
+#ifdef __linux__
+        for (auto fd : fds)
+            if (fd >= 0)
+                close(fd);
+#endif
+    }
+
+    /** Returns @c true if at least one counter is available. */
+    bool available() const {
+        for (auto fd : fds)
+            if (fd >= 0)
+                return true;
+        return false;
+    }
+
+    /** Resets and starts the counters. */
+    void start() {
+#ifdef __linux__
+        if (leader() >= 0) {
+            ioctl(leader(), PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(leader(), PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+#endif
+    }
+
+    /**
+     * Stops the counters and returns their values since the last call to start(). If the kernel multiplexed the group
+     * with other events, the values are scaled up to the time the group was enabled, and the counters that were never
+     * scheduled are unavailable.
+     */
+    values_type stop() {
+        values_type values;
+        values.fill(-1);
+#ifdef __linux__
+        if (leader() >= 0)
+            ioctl(leader(), PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        for (size_t i = 0; i < count; ++i) {
+            struct { uint64_t value, time_enabled, time_running; } data;
+            if (fds[i] < 0 || read(fds[i], &data, sizeof(data)) != sizeof(data) || data.time_running == 0)
+                continue;
+            auto value = double(data.value);
+            if (data.time_running < data.time_enabled)
+                value *= double(data.time_enabled) / double(data.time_running);
+            values[i] = int64_t(value);
+        }
+#endif
+        return values;
+    }
+
+    /** Adds the available counters of @p b to those of @p a. */
+    static void accumulate(values_type &a, const values_type &b) {
+        for (size_t i = 0; i < count; ++i)
+            a[i] = a[i] < 0 ? b[i] : (b[i] < 0 ? a[i] : a[i] + b[i]);
+    }
+};
+
+/**
+ * The sum of the performance counters of the threads of an OpenMP team, such as those that build an index in parallel.
+ *
+ * A PerfCounters counts only the thread that opened it, and the inherit flag of perf_event_open would not reach the
+ * threads of a pool that already exists. Hence, each thread of the team opens its own counters, in a parallel region
+ * with the same number of threads as the ones that will be measured, so that the runtime reuses the same threads.
+ */
+class TeamPerfCounters {
+    std::vector<std::unique_ptr<PerfCounters>> counters;
+
+public:
+
+    TeamPerfCounters() {
+#ifdef _OPENMP
+        counters.resize(omp_get_max_threads());
+        #pragma omp parallel num_threads(counters.size())
+        counters[omp_get_thread_num()] = std::make_unique<PerfCounters>();
+        counters.erase(std::remove(counters.begin(), counters.end(), nullptr), counters.end());
+#else
+        counters.push_back(std::make_unique<PerfCounters>());
+#endif
+    }
+
+    /** Resets and starts the counters of all the threads. */
+    void start() {
+        for (auto &c : counters)
+            c->start();
+    }
+
+    /** Stops the counters and returns the sum of their values over all the threads since the last call to start(). */
+    PerfCounters::values_type stop() {
+        PerfCounters::values_type values;
+        values.fill(-1);
+        for (auto &c : counters)
+            PerfCounters::accumulate(values, c->stop());
+        return values;
+    }
+};
@@ -0,0 +1,435 @@
+// This file is part of PGM-index <https://github.com/gvinciguerra/PGM-index>.
+// Copyright (c) 2021 Giorgio Vinciguerra.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "benchmark.hpp"
+
+#include <sys/utsname.h>
+#include <ctime>
+#include <iomanip>
+#include <map>
+#include <utility>
+
+#ifndef PGM_BENCHMARK_CXX_FLAGS
+#define PGM_BENCHMARK_CXX_FLAGS "unknown"
+#endif
+
+using Metadata = std::vector<std::pair<std::string, std::string>>;
+
+/** Returns the machine, the compiler and the options of the current run. */
+inline Metadata collect_metadata(const BenchmarkOptions &options, int argc, char **argv) {
+    std::string cpu = "unknown";
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    for (std::string line; std::getline(cpuinfo, line);) {
+        if (line.rfind("model name", 0) == 0 && line.find(':') != std::string::npos) {
+            cpu = line.substr(line.find(':') + 2);
+            break;
+        }
+    }
+
+    std::string system = "unknown";
+    utsname u{};
+    if (uname(&u) == 0)
+        system = std::string(u.sysname) + " " + u.release + " " + u.machine;
+
+    char date[32];
+    auto now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+    std::string command;
+    for (int i = 0; i < argc; ++i)
+        command += (i ? " " : "") + std::string(argv[i]);
+
+    std::string compiler;
+#if defined(__clang__)
+    compiler = "clang " __clang_version__;
+#elif defined(__GNUC__)
+    compiler = "gcc " __VERSION__;
+#else
+    compiler = "unknown";
+#endif
+
+    std::string openmp = "no";
+#ifdef _OPENMP
+    openmp = std::to_string(_OPENMP);
+#endif
+
+    return {
+        {"date", date},
+        {"command", command},
+        {"cpu", cpu},
+        {"cores", std::to_string(std::thread::hardware_concurrency())},
+        {"system", system},
+        {"compiler", compiler},
+        {"flags", PGM_BENCHMARK_CXX_FLAGS},
+        {"openmp", openmp},
+        {"threads", std::to_string(options.threads)},
+        {"repetitions", std::to_string(options.repetitions)},
+    };
+}
+
+/** The statistics of the keys of a dataset. */
+struct DatasetStats {
+    std::string name;
+    size_t keys;
+    size_t distinct;
+    std::string min;
+    std::string max;
+};
+
+template<typename K>
+DatasetStats dataset_stats(const std::string &name, const std::vector<K> &keys) {
+    DatasetStats s{name, keys.size(), 0, "", ""};
+    if (keys.empty())
+        return s;
+    s.distinct = 1;
+    for (size_t i = 1; i < keys.size(); ++i)
+        s.distinct += keys[i] != keys[i - 1];
+    s.min = std::to_string(keys.front());
+    s.max = std::to_string(keys.back());
+    return s;
+}
+
+inline std::string json_string(const std::string &s) {
+    std::ostringstream out;
+    out << '"';
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if (c < 0x20)
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec;
+        else
+            out << c;
+    }
+    out << '"';
+    return out.str();
+}
+
+/**
+ * Writes the output of the benchmark in the format given in the options. In CSV format, the metadata and the
+ * statistics of the datasets are comment lines starting with "#", and the rows are written as soon as they are
+ * available. In JSON format, everything is written by finish() as a single object.
+ */
+class ResultWriter {
+    BenchmarkOptions options;
+    Metadata metadata;
+    std::vector<DatasetStats> datasets;
+    std::vector<std::vector<ResultField>> rows;
+
+    bool json() const { return options.format == "json"; }
+
+public:
+
+    ResultWriter(const BenchmarkOptions &options, Metadata metadata)
+        : options(options), metadata(std::move(metadata)) {}
+
+    /** Writes the metadata and, if not empty, the header of the CSV output. */
+    void start(const std::string &header) {
+        if (json())
+            return;
+        for (auto &[key, value] : metadata)
+            std::cout << "# " << key << ": " << value << std::endl;
+        if (!header.empty())
+            std::cout << header << std::endl;
+    }
+
+    void dataset(const DatasetStats &s) {
+        if (json())
+            datasets.push_back(s);
+        else
+            std::cout << "# dataset " << s.name << ": keys=" << s.keys << ", distinct=" << s.distinct << ", min="
+                      << s.min << ", max=" << s.max << std::endl;
+    }
+
+    void row(const std::string &dataset, const std::string &distribution, const std::string &class_name,
+             const BenchmarkResult &r) {
+        if (json())
+            rows.push_back(result_fields(dataset, distribution, class_name, r, options));
+        else
+            print_csv_row(dataset, distribution, class_name, r, options);
+    }
+
+    void finish() {
+        if (!json())
+            return;
+        std::cout << "{\n  \"metadata\": {";
+        for (size_t i = 0; i < metadata.size(); ++i)
+            std::cout << (i ? ", " : "") << json_string(metadata[i].first) << ": " << json_string(metadata[i].second);
+        std::cout << "},\n  \"datasets\": [";
+        for (size_t i = 0; i < datasets.size(); ++i) {
+            auto &s = datasets[i];
+            std::cout << (i ? "," : "") << "\n    {\"name\": " << json_string(s.name) << ", \"keys\": " << s.keys
+                      << ", \"distinct\": " << s.distinct << ", \"min\": " << (s.keys ? s.min : "null")
+                      << ", \"max\": " << (s.keys ? s.max : "null") << "}";
+        }
+        std::cout << "\n  ],\n  \"results\": [";
+        for (size_t i = 0; i < rows.size(); ++i) {
+            std::cout << (i ? "," : "") << "\n    {";
+            for (size_t j = 0; j < rows[i].size(); ++j) {
+                auto &f = rows[i][j];
+                std::cout << (j ? ", " : "") << json_string(f.name) << ": "
+                          << (f.is_string ? json_string(f.value) : f.value.empty() ? "null" : f.value);
+            }
+            std::cout << "}";
+        }
+        std::cout << "\n  ]\n}" << std::endl;
+    }
+};
+
+/** A row of a result file, as a map from the column names to their values. */
+using ResultRow = std::map<std::string, std::string>;
+
+/** Splits a line of CSV on commas, except those between double quotes. */
+inline std::vector<std::string> split_csv_line(const std::string &line) {
+    std::vector<std::string> out(1);
+    bool quoted = false;
+    for (auto c : line) {
+        if (c == '"')
+            quoted = !quoted;
+        else if (c == ',' && !quoted)
+            out.emplace_back();
+        else
+            out.back() += c;
+    }
+    return out;
+}
+
+/**
+ * Reads the "results" array of a JSON file written by ResultWriter. The parser handles only what ResultWriter writes,
+ * that is, objects whose values are strings, numbers or null.
+ */
+inline std::vector<ResultRow> read_json_results(const std::string &text) {
+    auto pos = text.find("\"results\"");
+    if (pos == std::string::npos)
+        throw std::runtime_error("missing \"results\" array");
+    pos = text.find('[', pos);
+
+    auto skip_spaces = [&] {
+        while (pos < text.size() && std::isspace((unsigned char) text[pos]))
+            ++pos;
+    };
+    auto read_string = [&] {
+        std::string s;
+        for (++pos; pos < text.size() && text[pos] != '"'; ++pos) {
+            if (text[pos] == '\\' && pos + 1 < text.size()) {
+                ++pos;
+                if (text[pos] == 'u' && pos + 4 < text.size()) {
+                    s += char(std::stoi(text.substr(pos + 1, 4), nullptr, 16));
+                    pos += 4;
+                    continue;
+                }
+            }
+            s += text[pos];
+        }
+        ++pos;
+        return s;
+    };
+
+    std::vector<ResultRow> rows;
+    for (++pos, skip_spaces(); pos < text.size() && text[pos] == '{'; skip_spaces()) {
+        ResultRow row;
+        for (++pos, skip_spaces(); pos < text.size() && text[pos] != '}'; skip_spaces()) {
+            if (text[pos] == ',') {
+                ++pos;
+                continue;
+            }
+            auto key = read_string();
+            skip_spaces();
+            ++pos; // The colon
+            skip_spaces();
+            if (text[pos] == '"')
+                row[key] = read_string();
+            else {
+                auto end = text.find_first_of(",}", pos);
+                auto value = text.substr(pos, end - pos);
+                while (!value.empty() && std::isspace((unsigned char) value.back()))
+                    value.pop_back();
+                row[key] = value == "null" ? "" : value;
+                pos = end;
+            }
+        }
+        rows.push_back(std::move(row));
+        ++pos;
+        skip_spaces();
+        if (pos < text.size() && text[pos] == ',')
+            ++pos;
+    }
+    return rows;
+}
+
+/** Reads the rows of a CSV or JSON file written by the benchmark. */
+inline std::vector<ResultRow> read_results(const std::string &filename) {
+    std::ifstream in(filename);
+    if (!in)
+        throw std::runtime_error("cannot open " + filename);
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    auto text = buffer.str();
+
+    auto first = text.find_first_not_of(" \t\r\n");
+    if (first != std::string::npos && text[first] == '{')
+        return read_json_results(text);
+
+    std::vector<ResultRow> rows;
+    std::vector<std::string> header;
+    std::istringstream lines(text);
+    for (std::string line; std::getline(lines, line);) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        auto values = split_csv_line(line);
+        if (header.empty()) {
+            header = values;
+            continue;
+        }
+        ResultRow row;
+        for (size_t i = 0; i < header.size() && i < values.size(); ++i)
+            row[header[i]] = values[i];
+        rows.push_back(std::move(row));
+    }
+    return rows;
+}
+
+/** Returns the regularized incomplete beta function I_x(a, b), computed with a continued fraction. */
+inline double incomplete_beta(double a, double b, double x) {
+    if (x <= 0)
+        return 0;
+    if (x >= 1)
+        return 1;
+    if (x > (a + 1) / (a + b + 2))
+        return 1 - incomplete_beta(b, a, 1 - x);
+
+    const double tiny = 1e-300;
+    auto front = std::exp(std::lgamma(a + b) - std::lgamma(a) - std::lgamma(b) + a * std::log(x) + b * std::log1p(-x));
+    double c = 1;
+    double d = 1 - (a + b) * x / (a + 1);
+    d = 1 / (std::abs(d) < tiny ? tiny : d);
+    double f = d;
+    for (int m = 1; m <= 300; ++m) {
+        for (int odd = 0; odd <= 1; ++odd) {
+            auto num = odd ? -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 2 * m + 1))
+                           : m * (b - m) * x / ((a + 2 * m - 1) * (a + 2 * m));
+            d = 1 + num * d;
+            d = 1 / (std::abs(d) < tiny ? tiny : d);
+            c = 1 + num / c;
+            c = std::abs(c) < tiny ? tiny : c;
+            f *= c * d;
+        }
+        if (std::abs(c * d - 1) < 1e-12)
+            break;
+    }
+    return front * f / a;
+}
+
+/** Returns the probability that a Student's t variable with @p dof degrees of freedom is greater than @p t. */
+inline double student_t_sf(double t, double dof) {
+    auto tail = incomplete_beta(dof / 2, 0.5, dof / (dof + t * t)) / 2;
+    return t > 0 ? tail : 1 - tail;
+}
+
+/**
+ * Returns the p-value of Welch's one-sided t-test for the hypothesis that the mean of the second sample is greater than
+ * the one of the first, given the means, the standard deviations and the sizes of the samples.
+ */
+inline double welch_p_value(double mean1, double sd1, size_t n1, double mean2, double sd2, size_t n2) {
+    auto v1 = sd1 * sd1 / n1;
+    auto v2 = sd2 * sd2 / n2;
+    if (v1 + v2 == 0)
+        return mean2 > mean1 ? 0 : 1;
+    auto t = (mean2 - mean1) / std::sqrt(v1 + v2);
+    auto dof = (v1 + v2) * (v1 + v2) / (v1 * v1 / (n1 - 1) + v2 * v2 / (n2 - 1));
+    return student_t_sf(t, dof);
+}
+
+/** The options of the comparison of two result files. */
+struct CompareOptions {
+    double alpha = 0.05;      ///< The significance level of the test.
+    double threshold = 0.05;  ///< The relative change of the query time below which a difference is ignored.
+};
+
+/**
+ * Compares the query time and the space of the rows with the same dataset, distribution, class and threads in two result
+ * files, and prints a CSV line for each of them. A row is flagged as "slower" or "faster" if the relative change of its
+ * mean query time exceeds the threshold and, when both files have at least two repetitions, if Welch's t-test rejects
+ * the hypothesis that the query time is unchanged at the given significance level. Otherwise, the verdict is suffixed
+ * with "?" to mark that it is not backed by a test, and a slowdown counts as one on the sole basis of the threshold.
+ * @return the number of slowdowns
+ */
+inline size_t compare_results(const std::vector<ResultRow> &old_rows, const std::vector<ResultRow> &new_rows,
+                              const CompareOptions &options) {
+    auto key_of = [](const ResultRow &r) {
+        auto get = [&](const char *k) { return r.count(k) ? r.at(k) : ""; };
+        return std::make_tuple(get("dataset"), get("distribution"), get("class_name"), get("threads"));
+    };
+    auto number = [](const ResultRow &r, const char *k, double fallback) {
+        auto it = r.find(k);
+        return it == r.end() || it->second.empty() ? fallback : std::stod(it->second);
+    };
+
+    std::map<decltype(key_of(ResultRow{})), const ResultRow *> old_by_key;
+    for (auto &r : old_rows)
+        old_by_key[key_of(r)] = &r;
+
+    size_t slowdowns = 0;
+    std::cout << "dataset,distribution,class_name,threads,old_query_ns,new_query_ns,change,p_value,old_bytes,new_bytes,"
+                 "bytes_change,verdict" << std::endl;
+    for (auto &r : new_rows) {
+        auto[dataset, distribution, class_name, threads] = key_of(r);
+        std::cout << dataset << "," << distribution << ",\"" << class_name << "\"," << threads << ",";
+
+        auto it = old_by_key.find(key_of(r));
+        if (it == old_by_key.end()) {
+            std::cout << "," << number(r, "query_ns", 0) << ",,,," << number(r, "bytes", 0) << ",,added" << std::endl;
+            continue;
+        }
+        auto &o = *it->second;
+        old_by_key.erase(it);
+
+        auto old_ns = number(o, "query_ns", 0);
+        auto new_ns = number(r, "query_ns", 0);
+        auto old_n = size_t(number(o, "repetitions", 1));
+        auto new_n = size_t(number(r, "repetitions", 1));
+        auto change = old_ns > 0 ? new_ns / old_ns - 1 : 0;
+        auto old_bytes = number(o, "bytes", 0);
+        auto new_bytes = number(r, "bytes", 0);
+
+        std::string p_value;
+        std::string verdict = "unchanged";
+        auto tested = old_n > 1 && new_n > 1;
+        auto p_slower = 1., p_faster = 1.;
+        if (tested) {
+            auto old_sd = number(o, "query_ns_stddev", 0);
+            auto new_sd = number(r, "query_ns_stddev", 0);
+            p_slower = welch_p_value(old_ns, old_sd, old_n, new_ns, new_sd, new_n);
+            p_faster = welch_p_value(new_ns, new_sd, new_n, old_ns, old_sd, old_n);
+            p_value = std::to_string(std::min(p_slower, p_faster));
+        }
+        if (change > options.threshold && (!tested || p_slower < options.alpha)) {
+            verdict = tested ? "slower" : "slower?";
+            ++slowdowns;
+        } else if (change < -options.threshold && (!tested || p_faster < options.alpha))
+            verdict = tested ? "faster" : "faster?";
+
+        std::cout << old_ns << "," << new_ns << "," << change << "," << p_value << "," << old_bytes << "," << new_bytes
+                  << "," << (old_bytes > 0 ? new_bytes / old_bytes - 1 : 0) << "," << verdict << std::endl;
+    }
+
+    for (auto &[key, o] : old_by_key) {
+        auto[dataset, distribution, class_name, threads] = key;
+        std::cout << dataset << "," << distribution << ",\"" << class_name << "\"," << threads << ","
+                  << number(*o, "query_ns", 0) << ",,,," << number(*o, "bytes", 0) << ",,,removed" << std::endl;
+    }
+    return slowdowns;
+}
@@ -33,8 +33,15 @@
 #if defined(__BMI2__) || __AVX2__
 #define MORTON_ND_BMI2_ENABLED 1
 
+#if defined(MORTON_ND_BATCH_AVX512) && defined(__AVX512F__)
+#define MORTON_ND_BATCH_AVX512_ENABLED 1
+#else
+#define MORTON_ND_BATCH_AVX512_ENABLED 0
+#endif
+
 #include <array>
 #include <cmath>
+#include <cstdint>
 #include <limits>
 #include <tuple>
 #include <type_traits>
@@ -211,6 +218,267 @@ using MortonNDBmi_3D_32 = MortonNDBmi<3, uint32_t>;
  */
 using MortonNDBmi_3D_64 = MortonNDBmi<3, uint64_t>;
 
+/**
+ * An array-at-a-time N-dimensional Morton encoder/decoder.
+ *
+ * Produces the same codes as 'MortonNDBmi', but processes many points per call. The fields are
+ * passed as 'Dimensions' separate arrays (structure of arrays), so that consecutive values of a
+ * field can be loaded in a vector register.
+ *
+ * Each field is spread over the result with the "magic bits" method: at each step, the groups of
+ * bits of the field are halved in size and moved apart with a shift, an or and a mask. With AVX2,
+ * the steps process 256 bits of fields at once, while the leftover points (and targets without
+ * AVX2) are handled by 'MortonNDBmi'.
+ *
+ * 512-bit kernels are used if MORTON_ND_BATCH_AVX512 is defined on targets supporting AVX-512F.
+ * They are not enabled by default since they can be slower than the 256-bit ones, e.g. on CPUs
+ * that lower their clock frequency when executing 512-bit instructions.
+ *
+ * @tparam Dimensions the number of fields (components) to encode.
+ * @tparam T the type of the components to encode/decode, as well as the type of the result.
+ *         Must be either uint32_t or uint64_t.
+ */
+template<std::size_t Dimensions, typename T>
+class MortonNDBatch
+{
+    using Scalar = MortonNDBmi<Dimensions, T>;
+
+public:
+    static constexpr auto FieldBits = Scalar::FieldBits;
+
+    /**
+     * Calculates the Morton encodings of 'n' points.
+     *
+     * WARNING: Inputs must NOT use more than 'FieldBits' least-significant bits.
+     *
+     * @param fields the arrays with the 'n' values of each field.
+     * @param n the number of points to encode.
+     * @param encodings the output array of size 'n'.
+     */
+    static inline void Encode(const std::array<const T *, Dimensions> &fields, std::size_t n, T *encodings)
+    {
+        std::size_t i = 0;
+#if MORTON_ND_BATCH_AVX512_ENABLED
+        for (; i + Lanes512 <= n; i += Lanes512)
+            EncodeBlock<__m512i>(fields, i, encodings, std::make_index_sequence<Dimensions>{});
+#endif
+#if defined(__AVX2__)
+        for (; i + Lanes256 <= n; i += Lanes256)
+            EncodeBlock<__m256i>(fields, i, encodings, std::make_index_sequence<Dimensions>{});
+#endif
+        for (; i < n; ++i)
+            encodings[i] = EncodeScalar(fields, i, std::make_index_sequence<Dimensions>{});
+    }
+
+    /**
+     * Decodes 'n' Morton codes by de-interleaving them into their components.
+     *
+     * @param encodings the array of size 'n' with the Morton codes to decode.
+     * @param n the number of codes to decode.
+     * @param fields the output arrays for the 'n' values of each field.
+     */
+    static inline void Decode(const T *encodings, std::size_t n, const std::array<T *, Dimensions> &fields)
+    {
+        std::size_t i = 0;
+#if MORTON_ND_BATCH_AVX512_ENABLED
+        for (; i + Lanes512 <= n; i += Lanes512)
+            DecodeBlock<__m512i>(encodings, i, fields, std::make_index_sequence<Dimensions>{});
+#endif
+#if defined(__AVX2__)
+        for (; i + Lanes256 <= n; i += Lanes256)
+            DecodeBlock<__m256i>(encodings, i, fields, std::make_index_sequence<Dimensions>{});
+#endif
+        for (; i < n; ++i)
+            DecodeScalar(encodings[i], i, fields, std::make_index_sequence<Dimensions>{});
+    }
+
+private:
+    MortonNDBatch() = default;
+
+    static constexpr std::size_t Lanes512 = 64 / sizeof(T);
+    static constexpr std::size_t Lanes256 = 32 / sizeof(T);
+
+    /**
+     * The number of steps of the magic bits method, i.e. ceil(log2(FieldBits)).
+     */
+    static constexpr std::size_t Steps = [] {
+        std::size_t steps = 0;
+        while ((std::size_t(1) << steps) < FieldBits)
+            ++steps;
+        return steps;
+    }();
+
+    /**
+     * Returns the mask of the bits that hold a field when its bits are in groups of 'group' bits,
+     * and consecutive groups are 'Dimensions' * 'group' bits apart.
+     */
+    static constexpr T GroupMask(std::size_t group)
+    {
+        T mask = 0;
+        for (std::size_t b = 0; b < Dimensions * FieldBits; ++b)
+            if ((b / group) % Dimensions == 0)
+                mask |= T(1) << b;
+        return mask;
+    }
+
+    /**
+     * Masks[s] is the mask after the step that splits the field in groups of 2^s bits.
+     * Masks[Steps] keeps the 'FieldBits' least-significant bits.
+     */
+    static constexpr std::array<T, Steps + 1> Masks = [] {
+        std::array<T, Steps + 1> masks{};
+        for (std::size_t s = 0; s < Steps; ++s)
+            masks[s] = GroupMask(std::size_t(1) << s);
+        masks[Steps] = FieldBits == std::size_t(std::numeric_limits<T>::digits) ? ~T(0) : (T(1) << FieldBits) - 1;
+        return masks;
+    }();
+
+    template<size_t... i>
+    static inline T EncodeScalar(const std::array<const T *, Dimensions> &fields, std::size_t j,
+                                 std::index_sequence<i...>)
+    {
+        return Scalar::Encode(fields[i][j]...);
+    }
+
+    template<size_t... i>
+    static inline void DecodeScalar(T encoding, std::size_t j, const std::array<T *, Dimensions> &fields,
+                                    std::index_sequence<i...>)
+    {
+        auto decoded = Scalar::Decode(encoding);
+        ((fields[i][j] = std::get<i>(decoded)), ...);
+    }
+
+#if defined(__AVX2__)
+    // The helpers below operate on __m512i or __m256i vectors, told apart by their size
+    template<typename V>
+    static inline V Load(const T *p)
+    {
+#if MORTON_ND_BATCH_AVX512_ENABLED
+        if constexpr (sizeof(V) == 64)
+            return _mm512_loadu_si512(p);
+        else
+#endif
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    }
+
+    template<typename V>
+    static inline void Store(T *p, V x)
+    {
+#if MORTON_ND_BATCH_AVX512_ENABLED
+        if constexpr (sizeof(V) == 64)
+            _mm512_storeu_si512(p, x);
+        else
+#endif
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), x);
+    }
+
+    template<typename V>
+    static inline V Set1(T x)
+    {
+#if MORTON_ND_BATCH_AVX512_ENABLED
+        if constexpr (sizeof(V) == 64)
+            return sizeof(T) == 8 ? _mm512_set1_epi64(x) : _mm512_set1_epi32(x);
+        else
+#endif
+        return sizeof(T) == 8 ? _mm256_set1_epi64x(x) : _mm256_set1_epi32(x);
+    }
+
+    template<unsigned N, typename V>
+    static inline V ShiftLeft(V x)
+    {
+#if MORTON_ND_BATCH_AVX512_ENABLED
+        if constexpr (sizeof(V) == 64)
+            return sizeof(T) == 8 ? _mm512_slli_epi64(x, N) : _mm512_slli_epi32(x, N);
+        else
+#endif
+        return sizeof(T) == 8 ? _mm256_slli_epi64(x, N) : _mm256_slli_epi32(x, N);
+    }
+
+    template<unsigned N, typename V>
+    static inline V ShiftRight(V x)
+    {
+#if MORTON_ND_BATCH_AVX512_ENABLED
+        if constexpr (sizeof(V) == 64)
+            return sizeof(T) == 8 ? _mm512_srli_epi64(x, N) : _mm512_srli_epi32(x, N);
+        else
+#endif
+        return sizeof(T) == 8 ? _mm256_srli_epi64(x, N) : _mm256_srli_epi32(x, N);
+    }
+
+    template<typename V>
+    static inline V And(V x, V y)
+    {
+#if MORTON_ND_BATCH_AVX512_ENABLED
+        if constexpr (sizeof(V) == 64)
+            return _mm512_and_si512(x, y);
+        else
+#endif
+        return _mm256_and_si256(x, y);
+    }
+
+    template<typename V>
+    static inline V Or(V x, V y)
+    {
+#if MORTON_ND_BATCH_AVX512_ENABLED
+        if constexpr (sizeof(V) == 64)
+            return _mm512_or_si512(x, y);
+        else
+#endif
+        return _mm256_or_si256(x, y);
+    }
+
+    /**
+     * Spreads the bits of a field from groups of 2^('s' + 1) bits to groups of 2^'s' bits.
+     */
+    template<std::size_t s, typename V>
+    static inline V SpreadStep(V x)
+    {
+        return And(Or(x, ShiftLeft<(1U << s) * (Dimensions - 1)>(x)), Set1<V>(Masks[s]));
+    }
+
+    /**
+     * Compacts the bits of a field from groups of 2^'s' bits to groups of 2^('s' + 1) bits.
+     */
+    template<std::size_t s, typename V>
+    static inline V CompactStep(V x)
+    {
+        return And(Or(x, ShiftRight<(1U << s) * (Dimensions - 1)>(x)), Set1<V>(Masks[s + 1]));
+    }
+
+    template<typename V, std::size_t... s>
+    static inline V Spread(V x, std::index_sequence<s...>)
+    {
+        ((x = SpreadStep<Steps - 1 - s>(x)), ...);
+        return x;
+    }
+
+    template<typename V, std::size_t... s>
+    static inline V Compact(V x, std::index_sequence<s...>)
+    {
+        ((x = CompactStep<s>(x)), ...);
+        return x;
+    }
+
+    template<typename V, size_t... d>
+    static inline void EncodeBlock(const std::array<const T *, Dimensions> &fields, std::size_t j, T *encodings,
+                                   std::index_sequence<d...>)
+    {
+        V result = Set1<V>(0);
+        ((result = Or(result, ShiftLeft<d>(Spread(Load<V>(fields[d] + j), std::make_index_sequence<Steps>{})))), ...);
+        Store(encodings + j, result);
+    }
+
+    template<typename V, size_t... d>
+    static inline void DecodeBlock(const T *encodings, std::size_t j, const std::array<T *, Dimensions> &fields,
+                                   std::index_sequence<d...>)
+    {
+        V codes = Load<V>(encodings + j);
+        (Store(fields[d] + j, Compact(And(ShiftRight<d>(codes), Set1<V>(Masks[0])), std::make_index_sequence<Steps>{})),
+         ...);
+    }
+#endif
+};
+
 }
 
 #endif
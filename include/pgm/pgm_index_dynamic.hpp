@@ -20,6 +20,7 @@
 #include <cstdint>
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <iterator>
 #include <limits>
 #include <memory>
@@ -32,6 +33,15 @@
 
 namespace pgm {
 
+/**
+ * Statistics on the merges of the levels of a @ref DynamicPGMIndex, which are triggered by the insertions and deletions
+ * that overflow the buffer level.
+ */
+struct MergeStats {
+    size_t merges = 0;        ///< The number of merges.
+    uint64_t nanoseconds = 0; ///< The total time spent in the merges, including the rebuild of the indexes.
+};
+
 /**
  * A sorted associative container that contains key-value pairs with unique keys.
  * @tparam K the type of a key
@@ -40,6 +50,9 @@ namespace pgm {
  */
 template<typename K, typename V, typename PGMType = PGMIndex<K, 16>>
 class DynamicPGMIndex {
+    template<uint8_t, typename, typename, typename, typename>
+    friend class DynamicMultidimensionalPGMIndex;
+
     class ItemA;
     class ItemB;
     class Iterator;
@@ -54,6 +67,7 @@ class DynamicPGMIndex {
     uint8_t used_levels;           ///< Equal to 1 + last level whose size is greater than 0, or = min_level if no data.
     std::vector<Level> levels;     ///< (i-min_level)th element is the data array at the ith level.
     std::vector<PGMType> pgms;     ///< (i-min_index_level)th element is the index at the ith level.
+    MergeStats stats;              ///< The merges of the levels since the construction of the container.
 
     const Level &level(uint8_t level) const { return levels[level - min_level]; }
     const PGMType &pgm(uint8_t level) const { return pgms[level - min_index_level]; }
@@ -69,6 +83,7 @@ class DynamicPGMIndex {
                         uint8_t target,
                         size_t size_hint,
                         typename Level::iterator insertion_point) {
+        auto start = std::chrono::steady_clock::now();
         Level tmp_a(size_hint + level(target).size());
         Level tmp_b(size_hint + level(target).size());
 
@@ -109,6 +124,10 @@ class DynamicPGMIndex {
         // Rebuild index, if needed
         if (has_pgm(target))
             pgm(target) = PGMType(level(target).begin(), level(target).end());
+
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        ++stats.merges;
+        stats.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
     }
 
     void insert(const Item &new_item) {
@@ -165,7 +184,8 @@ public:
           buffer_max_size(),
           used_levels(min_level),
           levels(),
-          pgms() {
+          pgms(),
+          stats() {
         if (base < 2 || (base & (base - 1u)) != 0)
             throw std::invalid_argument("base must be a power of two");
 
@@ -394,6 +414,12 @@ public:
         return std::distance(begin(), end());
     }
 
+    /**
+     * Returns the number of merges of the levels since the construction of the container, and the time spent in them.
+     * @return the statistics on the merges of the levels
+     */
+    const MergeStats &merge_stats() const { return stats; }
+
     /**
      * Returns the size of the container (data + index structure) in bytes.
      * @return the size of the container in bytes
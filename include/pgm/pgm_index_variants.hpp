@@ -18,12 +18,15 @@
 #include "morton_nd.hpp"
 #include "piecewise_linear_model.hpp"
 #include "pgm_index.hpp"
+#include "pgm_index_dynamic.hpp"
 #include "sdsl.hpp"
 
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <algorithm>
+#include <array>
+#include <cassert>
 #include <cerrno>
 #include <climits>
 #include <cmath>
@@ -34,6 +37,7 @@
 #include <iterator>
 #include <limits>
 #include <numeric>
+#include <queue>
 #include <stdexcept>
 #include <string>
 #include <tuple>
@@ -68,6 +72,7 @@ using OneLevelPGMIndex = PGMIndex<K, Epsilon, 0, Floating>;
  */
 template<typename K, size_t Epsilon, size_t EpsilonRecursive = 4, typename Floating = float>
 class CompressedPGMIndex {
+protected:
     static_assert(Epsilon > 0);
     struct CompressedLevel;
 
@@ -82,33 +87,14 @@ class CompressedPGMIndex {
     using floating_pair = std::pair<Floating, Floating>;
     using canonical_segment = typename internal::OptimalPiecewiseLinearModel<K, size_t>::CanonicalSegment;
 
-public:
-
-    static constexpr size_t epsilon_value = Epsilon;
-
-    /**
-     * Constructs an empty index.
-     */
-    CompressedPGMIndex() = default;
-
-    /**
-     * Constructs the compressed index on the given sorted vector.
-     * @param data the vector of elements to be indexed, must be sorted
-     */
-    explicit CompressedPGMIndex(const std::vector<K> &data) : CompressedPGMIndex(data.begin(), data.end()) {}
-
-    /**
-     * Constructs the compressed index on the sorted elements in the range [first, last).
-     * @param first, last the range containing the sorted elements to be indexed
-     */
     template<typename Iterator>
-    CompressedPGMIndex(Iterator first, Iterator last) : n(std::distance(first, last)) {
+    void build(Iterator first, Iterator last, size_t epsilon) {
         if (n == 0)
             return;
 
         std::vector<size_t> levels_offsets({0});
         std::vector<canonical_segment> segments;
-        segments.reserve(n / (Epsilon * Epsilon));
+        segments.reserve(n / (epsilon * epsilon));
 
         auto ignore_last = *std::prev(last) == std::numeric_limits<K>::max(); // max is reserved for padding
         auto last_n = n - ignore_last;
@@ -121,7 +107,7 @@ public:
             return std::pair<K, size_t>(x + flag, i);
         };
         auto out_fun = [&](auto cs) { segments.emplace_back(cs); };
-        last_n = internal::make_segmentation_par(last_n, Epsilon, in_fun, out_fun);
+        last_n = internal::make_segmentation_par(last_n, epsilon, in_fun, out_fun);
         levels_offsets.push_back(levels_offsets.back() + last_n);
 
         // Build upper levels
@@ -158,32 +144,18 @@ public:
     }
 
     /**
-     * Returns the size of the index in bytes.
-     * @return the size of the index in bytes
-     */
-    size_t size_in_bytes() const {
-        size_t accum = 0;
-        for (auto &l : levels)
-            accum += l.size_in_bytes();
-        return accum + slopes_table.size() * sizeof(Floating);
-    }
-
-    /**
-     * Returns the approximate position and the range where @p key can be found.
+     * Returns the approximate position of @p key, without the bounds of the range where it can be found.
      * @param key the value of the element to search for
-     * @return a struct with the approximate position and bounds of the range
+     * @return the approximate position of the key
      */
-    ApproxPos search(const K &key) const {
+    size_t position(const K &key) const {
         auto k = std::max(first_key, key);
 
         if constexpr (EpsilonRecursive == 0) {
             auto &level = levels.front();
             auto it = std::upper_bound(level.keys.begin(), level.keys.begin() + level.size(), key);
             auto i = std::distance(level.keys.begin(), it) - 1;
-            auto pos = std::min<size_t>(level(slopes_table, i, k), level.get_intercept(i + 1));
-            auto lo = PGM_SUB_EPS(pos, Epsilon);
-            auto hi = PGM_ADD_EPS(pos, Epsilon, n);
-            return {pos, lo, hi};
+            return std::min<size_t>(level(slopes_table, i, k), level.get_intercept(i + 1));
         }
 
         auto p = int64_t(root_slope * (k - first_key)) + root_intercept;
@@ -205,6 +177,51 @@ public:
             pos = std::min<size_t>(level(slopes_table, i, k), level.get_intercept(i + 1));
         }
 
+        return pos;
+    }
+
+public:
+
+    static constexpr size_t epsilon_value = Epsilon;
+
+    /**
+     * Constructs an empty index.
+     */
+    CompressedPGMIndex() = default;
+
+    /**
+     * Constructs the compressed index on the given sorted vector.
+     * @param data the vector of elements to be indexed, must be sorted
+     */
+    explicit CompressedPGMIndex(const std::vector<K> &data) : CompressedPGMIndex(data.begin(), data.end()) {}
+
+    /**
+     * Constructs the compressed index on the sorted elements in the range [first, last).
+     * @param first, last the range containing the sorted elements to be indexed
+     */
+    template<typename Iterator>
+    CompressedPGMIndex(Iterator first, Iterator last) : n(std::distance(first, last)) {
+        build(first, last, Epsilon);
+    }
+
+    /**
+     * Returns the size of the index in bytes.
+     * @return the size of the index in bytes
+     */
+    size_t size_in_bytes() const {
+        size_t accum = 0;
+        for (auto &l : levels)
+            accum += l.size_in_bytes();
+        return accum + slopes_table.size() * sizeof(Floating);
+    }
+
+    /**
+     * Returns the approximate position and the range where @p key can be found.
+     * @param key the value of the element to search for
+     * @return a struct with the approximate position and bounds of the range
+     */
+    ApproxPos search(const K &key) const {
+        auto pos = position(key);
         auto lo = PGM_SUB_EPS(pos, Epsilon);
         auto hi = PGM_ADD_EPS(pos, Epsilon, n);
         return {pos, lo, hi};
@@ -215,7 +232,8 @@ public:
      * @return the number of segments
      */
     size_t segments_count() const {
-        return levels.back().size();
+        // If a single segment covers the data, it is the root and there are no levels below it
+        return levels.empty() ? size_t(n > 0) : levels.back().size();
     }
 
     /**
@@ -410,6 +428,15 @@ protected:
         top_level[actual_top_level_size - 1] = segments.size();
     }
 
+    template<typename RandomIt>
+    void build(RandomIt first, RandomIt last, size_t epsilon) {
+        if (n == 0)
+            return;
+        std::vector<size_t> offsets;
+        PGMIndex<K, Epsilon, 0, Floating>::build(first, last, epsilon, 0, segments, offsets);
+        build_top_level();
+    }
+
     /**
      * Returns the segment responsible for a given key, that is, the rightmost segment having key <= the sought key.
      * @param key the value of the element to search for
@@ -452,11 +479,7 @@ public:
           last_key(n ? *(last - 1) : K(0)),
           segments(),
           top_level() {
-        if (n == 0)
-            return;
-        std::vector<size_t> offsets;
-        PGMIndex<K, Epsilon, 0, Floating>::build(first, last, Epsilon, 0, segments, offsets);
-        build_top_level();
+        build(first, last, Epsilon);
     }
 
     /**
@@ -535,6 +558,24 @@ protected:
     std::vector<SegmentData> segments;  ///< The segments composing the index.
     sdsl::sd_vector<> ef;               ///< The Elias-Fano structure on the segment.
 
+    template<typename RandomIt>
+    void build(RandomIt first, RandomIt last, size_t epsilon) {
+        if (n == 0)
+            return;
+
+        std::vector<Segment> tmp;
+        std::vector<size_t> offsets;
+        PGMIndex<K, Epsilon, 0, Floating>::build(first, last, epsilon, 0, tmp, offsets);
+
+        segments.reserve(tmp.size());
+        for (auto &x: tmp) {
+            segments.push_back(x);
+            x.key -= first_key;
+        }
+
+        ef = decltype(ef)(tmp.begin(), std::prev(tmp.end()));
+    }
+
 public:
 
     static constexpr size_t epsilon_value = Epsilon;
@@ -560,20 +601,7 @@ public:
           first_key(n ? *first : K(0)),
           segments(),
           ef() {
-        if (n == 0)
-            return;
-
-        std::vector<Segment> tmp;
-        std::vector<size_t> offsets;
-        PGMIndex<K, Epsilon, 0, Floating>::build(first, last, Epsilon, 0, tmp, offsets);
-
-        segments.reserve(tmp.size());
-        for (auto &x: tmp) {
-            segments.push_back(x);
-            x.key -= first_key;
-        }
-
-        ef = decltype(ef)(tmp.begin(), std::prev(tmp.end()));
+        build(first, last, Epsilon);
     }
 
     /**
@@ -614,7 +642,7 @@ public:
         return segments.size() * sizeof(SegmentData) + sdsl::size_in_bytes(ef);
     }
 
-private:
+protected:
 
     std::pair<size_t, uint64_t> pred(uint64_t i) const {
         if (i > ef.size()) {
@@ -802,7 +830,9 @@ public:
      */
     auto end() const { return begin() + size(); }
 
-private:
+protected:
+
+    MappedPGMIndex() : base(), data(), file_bytes(), header_bytes() {}
 
     template<class RandomIt>
     void serialize_and_map(RandomIt first, RandomIt last, const std::string &out_filename) {
@@ -872,260 +902,955 @@ private:
     }
 };
 
+namespace internal {
+
+/**
+ * Sorts @p v using multiple threads: each thread sorts a chunk of the vector, and the sorted chunks are then merged
+ * pairwise in parallel rounds.
+ */
+template<typename T>
+void parallel_sort(std::vector<T> &v) {
+    auto n = v.size();
+    auto parallelism = std::min(omp_get_num_procs(), omp_get_max_threads());
+    if (parallelism == 1 || n < 1ull << 16) {
+        std::sort(v.begin(), v.end());
+        return;
+    }
+
+    std::vector<size_t> bounds(parallelism + 1);
+    for (auto i = 0; i <= parallelism; ++i)
+        bounds[i] = n * i / parallelism;
+
+    #pragma omp parallel for num_threads(parallelism)
+    for (auto i = 0; i < parallelism; ++i)
+        std::sort(v.begin() + bounds[i], v.begin() + bounds[i + 1]);
+
+    std::vector<T> tmp(n);
+    auto in = &v;
+    auto out = &tmp;
+    for (auto width = 1; width < parallelism; width *= 2) {
+        #pragma omp parallel for num_threads(parallelism)
+        for (auto i = 0; i < parallelism; i += 2 * width) {
+            auto lo = in->begin() + bounds[i];
+            auto mid = in->begin() + bounds[std::min(i + width, parallelism)];
+            auto hi = in->begin() + bounds[std::min(i + 2 * width, parallelism)];
+            std::merge(lo, mid, mid, hi, out->begin() + bounds[i]);
+        }
+        std::swap(in, out);
+    }
+
+    if (in != &v)
+        v.swap(tmp);
+}
+
+}
+
 #ifdef MORTON_ND_BMI2_ENABLED
 
 #include <immintrin.h>
 
 /**
- * A multidimensional container that uses a @ref PGMIndex for fast orthogonal range queries.
+ * A key policy for @ref MultidimensionalPGMIndex that linearises the elements along the Morton curve (Z-order).
+ *
+ * The codes can be 32-, 64- or 128-bit wide. With @c __uint128_t codes, the fields are 64-bit integers and each of
+ * them gets 128 / Dimensions bits of the code (e.g., 42 bits in 3D instead of the 21 bits of a 64-bit code).
  *
  * @tparam Dimensions the number of fields/dimensions
- * @tparam T the type of the stored elements
- * @tparam Epsilon the Epsilon parameter for the internal @ref PGMIndex
- * @tparam EpsilonRecursive the EpsilonRecursive parameter for the internal @ref PGMIndex
- * @tparam Floating the Floating parameter for the internal @ref PGMIndex
+ * @tparam T the type of the codes, and also of the fields for 32- and 64-bit codes
  */
-template<uint8_t Dimensions, typename T, size_t Epsilon, size_t EpsilonRecursive = 4, typename Floating = float>
-class MultidimensionalPGMIndex {
-    std::vector<T> data;
-    PGMIndex<T, Epsilon, EpsilonRecursive, Floating> pgm;
+template<uint8_t Dimensions, typename T>
+class MortonCurve {
+    static_assert(std::is_same_v<T, uint32_t> || std::is_same_v<T, uint64_t> || std::is_same_v<T, __uint128_t>,
+                  "MortonCurve supports 32-, 64- and 128-bit codes");
 
-    using morton = mortonnd::MortonNDBmi<Dimensions, T>;
-    static constexpr auto selector = mortonnd::BuildSelector<morton::FieldBits>(Dimensions);
-    static constexpr auto miss_threshold = 64;
+    static constexpr bool wide = sizeof(T) > sizeof(uint64_t);
 
-    class RangeIterator;
-    friend class RangeIterator;
+public:
+
+    using field_type = std::conditional_t<wide, uint64_t, T>;
+
+private:
+
+    using morton = mortonnd::MortonNDBmi<Dimensions, field_type>;
 
 public:
 
-    using iterator = RangeIterator;
-    using size_type = size_t;
+    static constexpr size_t field_bits = std::numeric_limits<T>::digits / Dimensions; ///< The bits of each field.
+
     using value_type = decltype(morton::Decode(0));
 
+    class Box;
+
     /**
-     * Constructs an empty multidimensional container.
+     * Returns the mask of the bits of a code that belong to the given @p dimension.
      */
-    MultidimensionalPGMIndex() = default;
+    static constexpr T selector(uint8_t dimension) { return selectors[dimension]; }
 
     /**
-     * Constructs the multidimensional container with the elements in the range [first, last).
-     * @param first, last the range to copy the elements from
+     * Scatters the lowest bits of @p field into the bits of a code that belong to the given @p dimension.
      */
-    template<typename RandomIt>
-    MultidimensionalPGMIndex(RandomIt first, RandomIt last) : data(), pgm() {
-        data.reserve(std::distance(first, last));
-        std::for_each(first, last, [&](const auto &x) {
-            std::apply([](auto &...x) {
-                if (((BIT_WIDTH(x) >= morton::FieldBits) || ...)) {
-                    auto tuple_str = ((std::to_string(x) + ",") + ...);
-                    throw std::runtime_error("Type is too small to encode (" + tuple_str + "\b)");
-                }
-            }, x);
-            data.emplace_back(encode(x));
-        });
-        std::sort(data.begin(), data.end());
-        pgm = decltype(pgm)(data.begin(), data.end());
+    static T deposit(field_type field, uint8_t dimension) {
+        auto s = selector(dimension);
+        if constexpr (wide) {
+            auto lo = _pdep_u64(field, uint64_t(s));
+            auto hi = _pdep_u64(field >> __builtin_popcountll(uint64_t(s)), uint64_t(s >> 64));
+            return (T(hi) << 64) | lo;
+        } else
+            return T(_pdep_u64(field, s));
     }
 
     /**
-     * Returns the size of the index in bytes.
-     * @return the size of the index in bytes
+     * Gathers the bits of @p code that belong to the given @p dimension.
      */
-    size_t size_in_bytes() const { return pgm.size_in_bytes(); }
+    static field_type extract(const T &code, uint8_t dimension) {
+        auto s = selector(dimension);
+        if constexpr (wide) {
+            auto lo = _pext_u64(uint64_t(code), uint64_t(s));
+            auto hi = _pext_u64(uint64_t(code >> 64), uint64_t(s >> 64));
+            return lo | (hi << __builtin_popcountll(uint64_t(s)));
+        } else
+            return field_type(_pext_u64(code, s));
+    }
 
     /**
-     * Checks if there is an element equal to @p p in the container.
-     * @param p the element to search for
-     * @return @c true if there is such an element, @c false otherwise
+     * Returns the code of the element with the given fields.
      */
-    bool contains(const value_type &p) {
-        auto zp = encode(p);
-        auto range = pgm.search(zp);
-        auto it = std::lower_bound(data.begin() + range.lo, data.begin() + range.hi, zp);
-        return it != data.end() || morton::Decode(*it) == p;
+    template<typename... Fields>
+    static T encode(Fields... fields) {
+        if constexpr (wide)
+            return encode_fields(std::make_index_sequence<Dimensions>(), field_type(fields)...);
+        else
+            return morton::Encode(fields...);
     }
 
     /**
-     * Returns an iterator to the first element of the container.
-     * @return an iterator to the first element of the container
+     * Returns the element with the given code.
      */
-    iterator begin() const { return iterator(data.begin()); }
+    static value_type decode(const T &code) {
+        if constexpr (wide)
+            return decode_fields(code, std::make_index_sequence<Dimensions>());
+        else
+            return morton::Decode(code);
+    }
 
     /**
-     * Returns an iterator to the element following the last element of the container.
-     * @return an iterator to the element following the last element of the container
+     * Writes to @p out the codes of @p n elements, whose ith field is taken from the array @p fields[i].
      */
-    iterator end() const { return iterator(data.end(), value_type()); }
+    static void encode_batch(const std::array<const field_type *, Dimensions> &fields, size_t n, T *out) {
+        if constexpr (wide) {
+            for (size_t j = 0; j < n; ++j)
+                out[j] = encode_fields(std::make_index_sequence<Dimensions>(), fields, j);
+        } else
+            mortonnd::MortonNDBatch<Dimensions, T>::Encode(fields, n, out);
+    }
 
-    /**
-     * Returns an iterator pointing to an element satisfying an orthogonal range query.
-     *
-     * Equivalently, returns an iterator to an element lying inside the hyperrectangle defined by the extreme points
-     * @p min and @p max.
-     *
-     * Successive elements can be retrieved by calling @c operator++() on the returned iterator @c it until
-     * @c it != end().
-     *
-     * @param min the lower extreme of the query hyperrectangle
-     * @param max the upper extreme of the query hyperrectangle, must be greater than or equal to min.
-     * @return an iterator pointing to an element inside the query hyperrectangle
-     */
-    iterator range(const value_type &min, const value_type &max) { return iterator(this, min, max); }
-    
-    /**
-     * (approximate) k-nearest neighbor query.
-     * Returns @p k nearest points from query point @p p.
-     * 
-     * @param p the query point.
-     * @param k the number of nearest points.
-     * @return a vector of k nearest points.
-     */
-    std::vector<value_type> knn(const value_type &p, uint32_t k){
-        // to access coordinate of point dynamically
-        using swallow = int[];
-        auto sequence = std::make_index_sequence<Dimensions>{};
-
-        // return euclidean distance between given point and query point p
-        auto dist_from_p = [&]<std::size_t... indices>(value_type point, std::index_sequence<indices...>){
-            uint64_t squared_sum = 0;
-            squared_sum = (std::pow((int64_t)std::get<indices>(point) - (int64_t)std::get<indices>(p), 2) + ... );
-            return std::sqrt(squared_sum);
-        };
+private:
 
-        // return first point of range query for knn query
-        auto k_range_first = [&]<std::size_t... indices>(uint64_t dist, std::index_sequence<indices...>) -> value_type{
-            value_type point;
-            swallow{
-                (std::get<indices>(point) = std::max<int64_t>((int64_t)std::get<indices>(p) - dist, 0), 0)...
-            };
-            return point;
-        };
+    static constexpr std::array<T, Dimensions> selectors = [] {
+        std::array<T, Dimensions> a{};
+        for (size_t b = 0; b < field_bits * Dimensions; ++b)
+            a[b % Dimensions] |= T(1) << b;
+        return a;
+    }();
 
-        // return end point of range query for knn query
-        auto k_range_end = [&]<std::size_t... indices>(uint64_t dist, std::index_sequence<indices...>) -> value_type{
-            value_type point;
-            swallow{
-                (std::get<indices>(point) = std::min<uint64_t>(std::get<indices>(p) + dist, this->data.size()), 0)...
-            };
-            return point;
-        };
+    template<size_t ...I, typename... Fields>
+    static T encode_fields(std::index_sequence<I...>, Fields... fields) { return (deposit(fields, I) | ...); }
 
-        // for debug
-        auto print_point = [&]<std::size_t... indices>(value_type point, std::index_sequence<indices...>){
-            std::cout << "(";
-            swallow{
-                (std::cout << std::get<indices>(point) << " , ", 0)...
-            };
-            std::cout << ")";
-        };
+    template<size_t ...I>
+    static T encode_fields(std::index_sequence<I...>, const std::array<const field_type *, Dimensions> &fields,
+                           size_t j) {
+        return (deposit(fields[I][j], I) | ...);
+    }
 
-        // get 2k points around zp to make temporary answer
-        auto zp = encode(p);
-        auto range = pgm.search(zp);
-        auto it = std::lower_bound(data.begin() + range.lo, data.begin() + range.hi, zp);
+    template<size_t ...I>
+    static value_type decode_fields(const T &code, std::index_sequence<I...>) { return {extract(code, I)...}; }
 
-        std::vector<value_type> tmp_ans;
-        for (auto i = it - k >= data.begin() ? it - k : data.begin(); i != it + k && i != data.end(); ++i)
-            tmp_ans.push_back(morton::Decode(*i));
+    /** Returns the position of the most significant set bit of @p x, or 0 if x is 0. */
+    static uint32_t hi(const T &x) {
+        if constexpr (wide)
+            return x >> 64 ? 64 + sdsl::bits::hi(uint64_t(x >> 64)) : sdsl::bits::hi(uint64_t(x));
+        else
+            return sdsl::bits::hi(x);
+    }
 
-        std::sort(tmp_ans.begin(), tmp_ans.end(), [&](auto const& lhs, auto const& rhs) {
-            double dist_l = dist_from_p(lhs, sequence);
-            double dist_r = dist_from_p(rhs, sequence);
-            return dist_l < dist_r;
-        });
+    template<size_t ...I>
+    constexpr static bool box_zcontains_field(const T &min, const T &max, const T &p, std::index_sequence<I...>) {
+        return (((min & selector(I)) <= (p & selector(I)) && (p & selector(I)) <= (max & selector(I))) && ...);
+    }
 
-        // calc distance of k nearest point in tmp_ans, and get a range(hyperrectangle) that contains more than k points around p
-        uint64_t k_range_dist = dist_from_p(tmp_ans[k - 1], sequence) + 1;
-        value_type first = k_range_first(k_range_dist, sequence);
-        value_type end = k_range_end(k_range_dist, sequence);
-        
-        // execute range query and get k nearest points
-        std::vector<value_type> ans;
-        for (auto it = this->range(first, end); it != this->end(); ++it)
-            ans.push_back(*it);
-
-        std::sort(ans.begin(), ans.end(), [&](auto const& lhs, auto const& rhs) {
-            double dist_l = dist_from_p(lhs, sequence);
-            double dist_r = dist_from_p(rhs, sequence);
-            return dist_l < dist_r;
-        });
-        
-        return std::vector<value_type> {ans.begin(), ans.begin() + k};
+    /**
+     * Returns @c true if and only if the given element @p p lies inside the hyperrectangle defined by the extremes
+     * @p min and @p max.
+     */
+    constexpr static bool box_zcontains(const T &min, const T &max, const T &p) {
+        return box_zcontains_field(min, max, p, std::make_index_sequence<Dimensions>());
     }
 
-private:
+    /**
+     * Loads @p pattern into the bits of @p target associated to the given @p dimension, starting at @p bit_position,
+     * leaving the other bits untouched.
+     */
+    static T load(T target, field_type pattern, uint8_t bit_position, uint8_t dimension) {
+        auto mask = ~deposit(sdsl::bits::lo_set[bit_position], dimension);
+        return (target & mask) | deposit(pattern, dimension);
+    }
 
-    class RangeIterator {
-        using multidimensional_pgm_type = MultidimensionalPGMIndex<Dimensions, T, Epsilon, EpsilonRecursive, Floating>;
-        using internal_iterator = typename decltype(multidimensional_pgm_type::data)::const_iterator;
+    /**
+     * Computes the lowest morton code within the range [@p min, @p max] greater than @p x.
+     */
+    static T bigmin(const T &xd, const T &min, const T &max) {
+        // http://hermanntropf.de/media/multidimensionalrangequery.pdf
+        T bigmin = 0;
+        T zmin = min;
+        T zmax = max;
+        auto hi_bit = std::max(std::max(hi(xd), hi(zmin)), hi(zmax));
 
-    public:
+        for (int b = hi_bit; b >= 0; --b) {
+            auto bits = b / Dimensions + 1;
+            auto dim = b % Dimensions;
+            auto decision = uint8_t((((xd >> b) & 1) << 2) | (((zmin >> b) & 1) << 1) | ((zmax >> b) & 1));
+            switch (decision) {
+                case 0b001:
+                    bigmin = load(zmin, field_type(1) << (bits - 1), bits, dim);
+                    zmax = load(zmax, sdsl::bits::lo_set[bits - 1], bits, dim);
+                    break;
 
-        using value_type = multidimensional_pgm_type::value_type;
-        using difference_type = typename internal_iterator::difference_type;
-        using pointer = const value_type *;
-        using reference = const value_type &;
-        using iterator_category = std::forward_iterator_tag;
+                case 0b011:
+                    bigmin = zmin;
+                    return bigmin;
 
-    private:
+                case 0b100:
+                    return bigmin;
 
-        const multidimensional_pgm_type *super;
-        multidimensional_pgm_type::value_type p;
-        internal_iterator it;
-        value_type min;
-        value_type max;
-        T zmin;
-        T zmax;
+                case 0b101:
+                    zmin = load(zmin, field_type(1) << (bits - 1), bits, dim);
+                    break;
+
+                default:
+                    continue;
+            }
+        }
+
+        return bigmin;
+    }
+};
+
+/**
+ * A query hyperrectangle of a @ref MortonCurve, whose codes lie between the codes of its two extremes.
+ */
+template<uint8_t Dimensions, typename T>
+class MortonCurve<Dimensions, T>::Box {
+    T zmin;
+    T zmax;
+
+public:
+
+    Box() = default;
+
+    Box(const value_type &min, const value_type &max)
+        : zmin(std::apply([](auto... x) { return encode(x...); }, min)),
+          zmax(std::apply([](auto... x) { return encode(x...); }, max)) {}
+
+    /** Returns @c true if and only if the element with code @p code lies inside the box. */
+    bool contains(const T &code) const { return box_zcontains(zmin, zmax, code); }
+
+    /** Returns the smallest code of an element inside the box. */
+    T first() const { return zmin; }
+
+    /** Returns the largest code of an element inside the box. */
+    T last() const { return zmax; }
+
+    /** Returns the smallest code of an element inside the box not less than @p code, which must be <= last(). */
+    T next(const T &code) const { return contains(code) ? code : bigmin(code, zmin, zmax); }
+};
+
+/**
+ * A key policy for @ref MultidimensionalPGMIndex that linearises the elements along the Hilbert curve.
+ *
+ * Unlike the Z-order, consecutive codes on the Hilbert curve always belong to adjacent cells, so the elements inside
+ * a query hyperrectangle are split into fewer and longer runs of codes, and range queries scan fewer elements that lie
+ * outside of it. The mapping follows C. Hamilton, "Compact Hilbert indices", Tech. Rep. CS-2006-07, 2006, and is
+ * implemented as a finite-state machine that rewrites the digits of the Morton code of an element, one level at a time.
+ *
+ * @tparam Dimensions the number of fields/dimensions
+ * @tparam T the type of the fields and of the codes
+ */
+template<uint8_t Dimensions, typename T>
+class HilbertCurve {
+    static_assert(Dimensions > 1 && Dimensions <= 5, "HilbertCurve supports from 2 to 5 dimensions");
+
+    using morton = MortonCurve<Dimensions, T>;
+    static constexpr size_t children = size_t(1) << Dimensions;
+    static constexpr size_t states = Dimensions * children;
+    static constexpr size_t chunk_digits = Dimensions == 2 ? 4 : (Dimensions == 3 ? 2 : 1);
+    static constexpr size_t chunks = size_t(1) << (chunk_digits * Dimensions);
+
+    /**
+     * The transitions of the state machine. A state encodes the orientation of the curve inside a cell, given by its
+     * entry corner and its direction, and each transition goes from a cell to one of its children. The chunk tables
+     * compose chunk_digits transitions to convert several digits of a code with a single lookup.
+     */
+    struct Tables {
+        uint8_t label[states * children];           ///< [state][digit] -> child as a bitmask over the dimensions.
+        uint16_t next[states * children];           ///< [state][digit] -> state of the child.
+        uint8_t digit[states * children];           ///< [state][label] -> position of the child in the visit order.
+        uint16_t next_label[states * children];     ///< [state][label] -> state of the child.
+        uint8_t chunk_label[states * chunks];       ///< [state][digits] -> labels of the descendants.
+        uint16_t chunk_next[states * chunks];       ///< [state][digits] -> state of the descendant.
+        uint8_t chunk_digit[states * chunks];       ///< [state][labels] -> digits of the descendants.
+        uint16_t chunk_next_label[states * chunks]; ///< [state][labels] -> state of the descendant.
+    };
+
+    static constexpr Tables make_tables() {
+        auto rotate_left = [](size_t x, size_t r) {
+            r %= Dimensions;
+            return ((x << r) | (x >> (Dimensions - r))) & (children - 1);
+        };
+        auto gray = [](size_t x) { return x ^ (x >> 1); };
+        auto trailing_ones = [](size_t x) {
+            size_t c = 0;
+            for (; x & 1; x >>= 1)
+                ++c;
+            return c;
+        };
+
+        Tables t{};
+        for (size_t entry = 0; entry < children; ++entry) {
+            for (size_t direction = 0; direction < Dimensions; ++direction) {
+                auto state = entry * Dimensions + direction;
+                for (size_t digit = 0; digit < children; ++digit) {
+                    auto child_entry = digit == 0 ? 0 : gray(2 * ((digit - 1) / 2));
+                    auto child_direction = digit == 0 ? 0 : trailing_ones(digit & 1 ? digit : digit - 1) % Dimensions;
+                    auto next_entry = entry ^ rotate_left(child_entry, direction + 1);
+                    auto next_direction = (direction + child_direction + 1) % Dimensions;
+                    auto label = rotate_left(gray(digit), direction + 1) ^ entry;
+                    auto next = uint16_t(next_entry * Dimensions + next_direction);
+                    t.label[state * children + digit] = uint8_t(label);
+                    t.next[state * children + digit] = next;
+                    t.digit[state * children + label] = uint8_t(digit);
+                    t.next_label[state * children + label] = next;
+                }
+            }
+        }
+
+        for (size_t state = 0; state < states; ++state) {
+            for (size_t digits = 0; digits < chunks; ++digits) {
+                size_t labels = 0;
+                auto s = state;
+                for (int i = chunk_digits - 1; i >= 0; --i) {
+                    auto digit = (digits >> (i * Dimensions)) & (children - 1);
+                    labels = (labels << Dimensions) | t.label[s * children + digit];
+                    s = t.next[s * children + digit];
+                }
+                t.chunk_label[state * chunks + digits] = uint8_t(labels);
+                t.chunk_next[state * chunks + digits] = uint16_t(s);
+                t.chunk_digit[state * chunks + labels] = uint8_t(digits);
+                t.chunk_next_label[state * chunks + labels] = uint16_t(s);
+            }
+        }
+        return t;
+    }
+
+    static constexpr Tables tables = make_tables();
+
+public:
+
+    static constexpr size_t field_bits = morton::field_bits; ///< The number of bits of each field in a code.
+
+    using field_type = typename morton::field_type;
+    using value_type = typename morton::value_type;
+
+    class Box;
+
+    /**
+     * Returns the code of the element with the given fields.
+     */
+    template<typename... Fields>
+    static T encode(Fields... fields) { return from_morton(morton::encode(fields...)); }
+
+    /**
+     * Returns the element with the given code.
+     */
+    static value_type decode(const T &code) { return morton::decode(to_morton(code)); }
+
+    /**
+     * Writes to @p out the codes of @p n elements, whose ith field is taken from the array @p fields[i].
+     */
+    static void encode_batch(const std::array<const field_type *, Dimensions> &fields, size_t n, T *out) {
+        morton::encode_batch(fields, n, out);
+        for (size_t j = 0; j < n; ++j)
+            out[j] = from_morton(out[j]);
+    }
+
+private:
+
+    /** Rewrites the digits of a Hilbert code into those of a Morton code, or vice versa. */
+    template<bool ToMorton>
+    static T rewrite(const T &code) {
+        constexpr auto head_levels = field_bits % chunk_digits;
+        constexpr auto chunk_bits = chunk_digits * Dimensions;
+        auto &out_table = ToMorton ? tables.label : tables.digit;
+        auto &next_table = ToMorton ? tables.next : tables.next_label;
+        auto &chunk_out_table = ToMorton ? tables.chunk_label : tables.chunk_digit;
+        auto &chunk_next_table = ToMorton ? tables.chunk_next : tables.chunk_next_label;
+
+        T out = 0;
+        size_t state = 0;
+        for (int level = field_bits - 1; level >= int(field_bits - head_levels); --level) {
+            auto i = state * children + size_t((code >> (level * Dimensions)) & (children - 1));
+            out = (out << Dimensions) | out_table[i];
+            state = next_table[i];
+        }
+        for (int level = field_bits - head_levels - chunk_digits; level >= 0; level -= chunk_digits) {
+            auto i = state * chunks + size_t((code >> (level * Dimensions)) & (chunks - 1));
+            out = (out << chunk_bits) | chunk_out_table[i];
+            state = chunk_next_table[i];
+        }
+        return out;
+    }
+
+    /** Returns the Morton code of the element with the given Hilbert code. */
+    static T to_morton(const T &code) { return rewrite<true>(code); }
+
+    /** Returns the Hilbert code of the element with the given Morton code. */
+    static T from_morton(const T &z) { return rewrite<false>(z); }
+};
+
+/**
+ * A query hyperrectangle of a @ref HilbertCurve.
+ *
+ * The smallest code inside the box that is not less than a given code is found by descending the cells visited by the
+ * curve, in the same way as the BIGMIN computation of the Z-order: it follows the cells containing the given code and
+ * falls back to the deepest cell that is visited later by the curve and that intersects the box.
+ */
+template<uint8_t Dimensions, typename T>
+class HilbertCurve<Dimensions, T>::Box {
+    T zmin;
+    T zmax;
+    T first_code;
+    T last_code;
+
+    template<size_t ...I>
+    bool intersects_field(const T &cell_min, const T &cell_max, std::index_sequence<I...>) const {
+        return (((cell_min & morton::selector(I)) <= (zmax & morton::selector(I))
+            && (zmin & morton::selector(I)) <= (cell_max & morton::selector(I))) && ...);
+    }
+
+    /** Returns @c true iff the cell of side 2^@p level whose lowest corner has Morton code @p z intersects the box. */
+    bool intersects(const T &z, uint8_t level) const {
+        auto bits = level * Dimensions;
+        auto cell_max = z | (bits >= std::numeric_limits<T>::digits ? ~T(0) : (T(1) << bits) - 1);
+        return intersects_field(z, cell_max, std::make_index_sequence<Dimensions>());
+    }
+
+    /**
+     * Returns the smallest (or largest) code inside the box and inside the cell of side 2^(@p level + 1) reached by the
+     * prefix @p code, which has lowest corner @p z and is traversed with the given @p state.
+     */
+    template<bool Smallest>
+    T descend(T code, size_t state, T z, int level) const {
+        for (; level >= 0; --level) {
+            for (size_t i = 0; i < children; ++i) {
+                auto digit = Smallest ? i : children - 1 - i;
+                auto child = z | (T(tables.label[state * children + digit]) << (level * Dimensions));
+                if (intersects(child, level)) {
+                    code = (code << Dimensions) | digit;
+                    state = tables.next[state * children + digit];
+                    z = child;
+                    break;
+                }
+            }
+        }
+        return code;
+    }
+
+public:
+
+    Box() = default;
+
+    Box(const value_type &min, const value_type &max)
+        : zmin(std::apply([](auto... x) { return morton::encode(x...); }, min)),
+          zmax(std::apply([](auto... x) { return morton::encode(x...); }, max)),
+          first_code(descend<true>(0, 0, 0, field_bits - 1)),
+          last_code(descend<false>(0, 0, 0, field_bits - 1)) {}
+
+    /** Returns @c true if and only if the element with code @p code lies inside the box. */
+    bool contains(const T &code) const {
+        auto z = to_morton(code);
+        return intersects_field(z, z, std::make_index_sequence<Dimensions>());
+    }
+
+    /** Returns the smallest code of an element inside the box. */
+    T first() const { return first_code; }
+
+    /** Returns the largest code of an element inside the box. */
+    T last() const { return last_code; }
+
+    /** Returns the smallest code of an element inside the box not less than @p code, which must be <= last(). */
+    T next(const T &code) const {
+        size_t state = 0;
+        T z = 0;
+        T prefix = 0;
+
+        // The deepest cell that is visited after the one containing code and that intersects the box
+        [[maybe_unused]] auto has_fallback = false;
+        int fallback_level = 0;
+        size_t fallback_state = 0;
+        T fallback_z = 0;
+        T fallback_prefix = 0;
+
+        for (int level = field_bits - 1; level >= 0; --level) {
+            auto digit = size_t(code >> (level * Dimensions)) & (children - 1);
+            for (auto d = digit + 1; d < children; ++d) {
+                auto child = z | (T(tables.label[state * children + d]) << (level * Dimensions));
+                if (intersects(child, level)) {
+                    has_fallback = true;
+                    fallback_level = level - 1;
+                    fallback_state = tables.next[state * children + d];
+                    fallback_z = child;
+                    fallback_prefix = (prefix << Dimensions) | d;
+                    break;
+                }
+            }
+
+            auto child = z | (T(tables.label[state * children + digit]) << (level * Dimensions));
+            if (!intersects(child, level))
+                break;
+            if (level == 0)
+                return code;
+            state = tables.next[state * children + digit];
+            z = child;
+            prefix = (prefix << Dimensions) | digit;
+        }
+
+        assert(has_fallback);
+        return descend<true>(fallback_prefix, fallback_state, fallback_z, fallback_level);
+    }
+};
+
+/**
+ * A multidimensional container that uses a @ref PGMIndex for fast orthogonal range queries.
+ *
+ * The elements are mapped to one-dimensional codes by the space-filling curve given by the @p Curve policy, either
+ * @ref MortonCurve (the default) or @ref HilbertCurve.
+ *
+ * If @p V is not @c void, each element carries a payload of type @p V, which is stored in a column kept in the same
+ * order of the codes, so that the payloads of the results of a range query are read sequentially from memory.
+ *
+ * @tparam Dimensions the number of fields/dimensions
+ * @tparam T the type of the stored elements
+ * @tparam Epsilon the Epsilon parameter for the internal @ref PGMIndex
+ * @tparam EpsilonRecursive the EpsilonRecursive parameter for the internal @ref PGMIndex
+ * @tparam Floating the Floating parameter for the internal @ref PGMIndex
+ * @tparam Curve the space-filling curve that maps the elements to codes
+ * @tparam V the type of the payload of an element, or @c void for no payload
+ */
+template<uint8_t Dimensions, typename T, size_t Epsilon, size_t EpsilonRecursive = 4, typename Floating = float,
+         typename Curve = MortonCurve<Dimensions, T>, typename V = void>
+class MultidimensionalPGMIndex {
+    static constexpr bool has_payload = !std::is_void_v<V>;
+
+    std::vector<T> data;
+    std::vector<std::conditional_t<has_payload, V, char>> payload; ///< The payloads, in the same order of data.
+    PGMIndex<T, Epsilon, EpsilonRecursive, Floating> pgm;
+
+    static constexpr auto miss_threshold = 64;
+    static constexpr auto knn_leaf_size = 32;
+    static constexpr auto join_leaf_size = 16;
+    static constexpr auto count_leaf_size = 64;
+    static constexpr auto boxes_per_thread = 4;
+    static constexpr size_t encode_block_size = 1024;
+
+    /** The type of squared Euclidean distances, wide enough to hold the distance between any two cells. */
+    using distance_type = std::conditional_t<2 * Curve::field_bits + BIT_WIDTH(Dimensions) <= 64,
+                                             uint64_t, __uint128_t>;
+
+    /** A cell of the 2^Dimensions-ary tree induced by the curve, which spans a contiguous range of codes. */
+    struct Cell {
+        T zmin;        ///< The smallest code in the cell.
+        uint8_t level; ///< The cell spans 2^level values along each dimension.
+        size_t lo;     ///< The position in data of the first element in the cell.
+        size_t hi;     ///< The position in data following the last element in the cell.
+    };
+
+    class RangeIterator;
+    friend class RangeIterator;
+
+public:
+
+    using iterator = RangeIterator;
+    using size_type = size_t;
+    using value_type = typename Curve::value_type;
+
+    /**
+     * Constructs an empty multidimensional container.
+     */
+    MultidimensionalPGMIndex() = default;
+
+    /**
+     * Constructs the multidimensional container with the elements in the range [first, last). If the container has
+     * payloads, they are value-initialised.
+     * @param first, last the range to copy the elements from
+     */
+    template<typename RandomIt>
+    MultidimensionalPGMIndex(RandomIt first, RandomIt last)
+        : data(std::distance(first, last)),
+          payload(has_payload ? data.size() : 0),
+          pgm() {
+        encode_all(first);
+        internal::parallel_sort(data);
+        pgm = decltype(pgm)(data.begin(), data.end());
+    }
+
+    /**
+     * Constructs the multidimensional container with the elements in the range [first, last) and their payloads.
+     * @param first, last the range to copy the elements from
+     * @param payload_first the beginning of the range to copy the payloads from, the ith of which belongs to the ith
+     *                      element in [first, last)
+     */
+    template<typename RandomIt, typename PayloadIt>
+    MultidimensionalPGMIndex(RandomIt first, RandomIt last, PayloadIt payload_first)
+        : data(std::distance(first, last)),
+          payload(),
+          pgm() {
+        static_assert(has_payload, "The container has no payload");
+        encode_all(first);
+
+        auto n = data.size();
+        std::vector<std::pair<T, size_t>> order(n);
+        #pragma omp parallel for
+        for (size_t i = 0; i < n; ++i)
+            order[i] = {data[i], i};
+        internal::parallel_sort(order);
+
+        payload.resize(n);
+        #pragma omp parallel for
+        for (size_t i = 0; i < n; ++i) {
+            data[i] = order[i].first;
+            payload[i] = payload_first[order[i].second];
+        }
+        pgm = decltype(pgm)(data.begin(), data.end());
+    }
+
+    /**
+     * Returns the size of the index in bytes.
+     * @return the size of the index in bytes
+     */
+    size_t size_in_bytes() const { return pgm.size_in_bytes(); }
+
+    /**
+     * Checks if there is an element equal to @p p in the container.
+     * @param p the element to search for
+     * @return @c true if there is such an element, @c false otherwise
+     */
+    bool contains(const value_type &p) const {
+        auto zp = encode(p);
+        auto range = pgm.search(zp);
+        auto it = std::lower_bound(data.begin() + range.lo, data.begin() + range.hi, zp);
+        return it != data.end() && *it == zp;
+    }
+
+    /**
+     * Returns an iterator to the first element of the container.
+     * @return an iterator to the first element of the container
+     */
+    iterator begin() const { return iterator(this, data.begin()); }
+
+    /**
+     * Returns an iterator to the element following the last element of the container.
+     * @return an iterator to the element following the last element of the container
+     */
+    iterator end() const { return iterator(this, data.end(), value_type()); }
+
+    /**
+     * Returns an iterator pointing to an element satisfying an orthogonal range query.
+     *
+     * Equivalently, returns an iterator to an element lying inside the hyperrectangle defined by the extreme points
+     * @p min and @p max.
+     *
+     * Successive elements can be retrieved by calling @c operator++() on the returned iterator @c it until
+     * @c it != end().
+     *
+     * @param min the lower extreme of the query hyperrectangle
+     * @param max the upper extreme of the query hyperrectangle, must be greater than or equal to min.
+     * @return an iterator pointing to an element inside the query hyperrectangle
+     */
+    iterator range(const value_type &min, const value_type &max) const { return iterator(this, min, max); }
+
+    /**
+     * Returns the number of elements lying inside the hyperrectangle defined by the extreme points @p min and @p max.
+     *
+     * Unlike counting the elements returned by range(), this does not decode any element. The query descends the
+     * cells of the 2^Dimensions-ary tree induced by the curve, starting from the smallest cell enclosing the box: the
+     * elements of a cell lying entirely inside the box are counted in O(1) from its bounds in the sorted codes, which
+     * are found via the PGM-index, while the cells that are too small to be worth splitting are scanned by testing
+     * their codes against the box.
+     *
+     * @param min the lower extreme of the query hyperrectangle
+     * @param max the upper extreme of the query hyperrectangle, must be greater than or equal to min
+     * @return the number of elements inside the query hyperrectangle
+     */
+    size_t range_count(const value_type &min, const value_type &max) const {
+        size_t count = 0;
+        for_each_run(min, max, [&](size_t lo, size_t hi) { count += hi - lo; });
+        return count;
+    }
+
+    /**
+     * Folds with @p op the payloads of the elements lying inside the hyperrectangle defined by the extreme points
+     * @p min and @p max, starting from @p init. The payloads are visited in runs found as in range_count(), without
+     * decoding any element, and in an unspecified order, so @p op should be associative and commutative. For example,
+     * @code range_aggregate(min, max, V(0), [](V a, const V &b) { return std::max(a, b); }) @endcode computes the
+     * largest payload (or 0, if the box is empty).
+     *
+     * @param min the lower extreme of the query hyperrectangle
+     * @param max the upper extreme of the query hyperrectangle, must be greater than or equal to min
+     * @param init the initial value of the fold
+     * @param op the binary function to fold the payloads with, with signature R(R, const V &)
+     * @return the result of the fold
+     */
+    template<typename R, typename BinaryOp>
+    R range_aggregate(const value_type &min, const value_type &max, R init, BinaryOp op) const {
+        static_assert(has_payload, "The container has no payload");
+        for_each_run(min, max, [&](size_t lo, size_t hi) {
+            for (auto i = lo; i < hi; ++i)
+                init = op(std::move(init), payload[i]);
+        });
+        return init;
+    }
+
+    /**
+     * Returns the sum of the payloads of the elements lying inside the hyperrectangle defined by the extreme points
+     * @p min and @p max.
+     *
+     * @param min the lower extreme of the query hyperrectangle
+     * @param max the upper extreme of the query hyperrectangle, must be greater than or equal to min
+     * @return the sum of the payloads inside the query hyperrectangle
+     */
+    template<typename U = V>
+    U range_sum(const value_type &min, const value_type &max) const {
+        return range_aggregate(min, max, U(), [](U a, const U &b) { return a + b; });
+    }
+
+    /**
+     * Returns the elements lying inside the hyperrectangle defined by the extreme points @p min and @p max, computed
+     * in parallel.
+     *
+     * The box is split along the boundaries of the cells of the Z-order into sub-boxes whose elements span disjoint
+     * ranges of codes, and each sub-box is scanned by its own iterator on one of @p parallelism threads. With the
+     * default @ref MortonCurve, concatenating the returned chunks gives the elements in the same order of range().
+     *
+     * @param min the lower extreme of the query hyperrectangle
+     * @param max the upper extreme of the query hyperrectangle, must be greater than or equal to min
+     * @param parallelism the number of threads to use
+     * @return a vector with the elements of each sub-box, some of which may be empty
+     */
+    std::vector<std::vector<value_type>> range_par(const value_type &min, const value_type &max,
+                                                   int parallelism = omp_get_max_threads()) const {
+        auto boxes = split_box(min, max, parallelism);
+        std::vector<std::vector<value_type>> chunks(boxes.size());
+        #pragma omp parallel for schedule(dynamic) num_threads(parallelism)
+        for (size_t i = 0; i < boxes.size(); ++i)
+            for (auto it = range(boxes[i].first, boxes[i].second); it != end(); ++it)
+                chunks[i].push_back(*it);
+        return chunks;
+    }
+
+    /**
+     * Calls @p f on each element lying inside the hyperrectangle defined by the extreme points @p min and @p max,
+     * using @p parallelism threads in the same way as range_par().
+     *
+     * The function @p f is called concurrently by different threads, so it must be thread-safe.
+     *
+     * @param min the lower extreme of the query hyperrectangle
+     * @param max the upper extreme of the query hyperrectangle, must be greater than or equal to min
+     * @param f the function to call on each element, with signature void(const value_type &)
+     * @param parallelism the number of threads to use
+     */
+    template<typename F>
+    void range_for_each_par(const value_type &min, const value_type &max, F f,
+                            int parallelism = omp_get_max_threads()) const {
+        auto boxes = split_box(min, max, parallelism);
+        #pragma omp parallel for schedule(dynamic) num_threads(parallelism)
+        for (size_t i = 0; i < boxes.size(); ++i)
+            for (auto it = range(boxes[i].first, boxes[i].second); it != end(); ++it)
+                f(*it);
+    }
+
+    /**
+     * Returns the @p k elements closest to @p p in Euclidean distance, sorted by increasing distance.
+     *
+     * The search visits the cells of the 2^Dimensions-ary tree induced by the curve in best-first order, keeping the
+     * closest elements found so far in a bounded max-heap, and stops as soon as the k-th closest element is not
+     * farther than the closest unexplored cell. Ties are broken arbitrarily. As in the construction, the fields of
+     * @p p must be encodable by the curve, otherwise a std::runtime_error is thrown.
+     *
+     * @param p the query point
+     * @param k the number of elements to return
+     * @return a vector with the min(k, size()) elements closest to @p p
+     */
+    std::vector<value_type> knn(const value_type &p, size_t k) const {
+        if (!encodable(p)) {
+            auto tuple_str = std::apply([](auto &...x) { return ((std::to_string(x) + ",") + ...); }, p);
+            throw std::runtime_error("Type is too small to encode (" + tuple_str + "\b)");
+        }
+        if (k == 0 || data.empty())
+            return {};
+
+        using candidate = std::pair<distance_type, T>;
+        using queued_cell = std::pair<distance_type, Cell>;
+        auto cmp_cells = [](const queued_cell &a, const queued_cell &b) { return a.first > b.first; };
+        std::priority_queue<candidate> candidates;
+        std::priority_queue<queued_cell, std::vector<queued_cell>, decltype(cmp_cells)> cells(cmp_cells);
+        cells.emplace(0, Cell{0, Curve::field_bits, 0, data.size()});
+
+        while (!cells.empty()) {
+            auto[cell_distance, cell] = cells.top();
+            if (candidates.size() == k && cell_distance >= candidates.top().first)
+                break;
+            cells.pop();
+
+            if (cell.level == 0 || cell.hi - cell.lo <= knn_leaf_size) {
+                for (auto i = cell.lo; i < cell.hi; ++i) {
+                    auto d = distance(p, Curve::decode(data[i]), 0);
+                    if (candidates.size() < k)
+                        candidates.emplace(d, data[i]);
+                    else if (d < candidates.top().first) {
+                        candidates.pop();
+                        candidates.emplace(d, data[i]);
+                    }
+                }
+                continue;
+            }
+
+            for_each_child(cell, [&](const Cell &child) {
+                auto d = distance(p, cell_corner(child), child.level);
+                if (candidates.size() < k || d < candidates.top().first)
+                    cells.emplace(d, child);
+            });
+        }
+
+        std::vector<value_type> result(candidates.size());
+        for (auto it = result.rbegin(); it != result.rend(); ++it, candidates.pop())
+            *it = Curve::decode(candidates.top().second);
+        return result;
+    }
+
+    /**
+     * Calls @p f on each pair of elements @c a of this container and @c b of @p other such that, for each dimension
+     * @c i, the fields of @c a and @c b differ by at most the ith field of @p radius.
+     *
+     * The two sorted arrays of codes are merged in a single synchronized pass. This container is traversed along the
+     * cells of the 2^Dimensions-ary tree induced by the curve, in the order of the codes, while a cursor on @p other
+     * follows the codes of the cells enlarged by @p radius. A cell whose enlarged hypercube has no code of @p other in
+     * its range of codes is skipped with all its elements. The elements of each small cell are compared with those of
+     * @p other in the bounding box of the cell enlarged by @p radius, which are scanned from the cursor skipping the
+     * runs of codes outside the box as range() does. The cursor moves by galloping searches from its last position
+     * rather than by searches in the index, so nearby cells cost time logarithmic in the distance between their codes,
+     * and the cost of the join is near-linear in the sizes of the inputs plus the size of the output.
+     *
+     * @param other the container to join with
+     * @param radius the maximum difference allowed between the fields of a pair of elements, in each dimension
+     * @param f the function to call on each pair, with signature void(const value_type &a, const value_type &b)
+     */
+    template<typename F>
+    void join(const MultidimensionalPGMIndex &other, const value_type &radius, F f) const {
+        join_with(other, f, radius, [&](const value_type &a, const value_type &b) {
+            return within_radius(a, b, radius, std::make_index_sequence<Dimensions>());
+        });
+    }
+
+    /**
+     * Calls @p f on each pair of elements @c a of this container and @c b of @p other whose Euclidean distance is at
+     * most @p radius. The containers are traversed in the same way as join().
+     *
+     * @param other the container to join with
+     * @param radius the maximum Euclidean distance between a pair of elements
+     * @param f the function to call on each pair, with signature void(const value_type &a, const value_type &b)
+     */
+    template<typename F>
+    void distance_join(const MultidimensionalPGMIndex &other, typename Curve::field_type radius, F f) const {
+        // No two encodable fields differ by more than 2^field_bits - 1, so a larger radius would only overflow the square
+        auto clamped = std::min<distance_type>(radius, (distance_type(1) << Curve::field_bits) - 1);
+        auto squared_radius = clamped * clamped;
+        value_type radii;
+        std::apply([&](auto &...x) { ((x = radius), ...); }, radii);
+        join_with(other, f, radii, [&](const value_type &a, const value_type &b) {
+            return distance(a, b, 0) <= squared_radius;
+        });
+    }
+
+private:
+
+    class RangeIterator {
+        using multidimensional_pgm_type = MultidimensionalPGMIndex<Dimensions, T, Epsilon, EpsilonRecursive,
+                                                                   Floating, Curve, V>;
+        using internal_iterator = typename decltype(multidimensional_pgm_type::data)::const_iterator;
+
+    public:
+
+        using value_type = typename multidimensional_pgm_type::value_type;
+        using difference_type = typename internal_iterator::difference_type;
+        using pointer = const value_type *;
+        using reference = const value_type &;
+        using iterator_category = std::forward_iterator_tag;
+
+    private:
+
+        const multidimensional_pgm_type *super;
+        value_type p;
+        internal_iterator it;
+        typename Curve::Box box;
         int miss;
 
         void advance() {
             ++it;
-            if (miss == -1)
+            if (miss == -1) {
+                if (it != super->data.end())
+                    this->p = Curve::decode(*it);
                 return;
+            }
 
-            while (it != super->data.end() && *it <= zmax) {
-                if (box_zcontains(zmin, zmax, *it)) {
-                    this->p = morton::Decode(*it);
+            while (it != super->data.end() && *it <= box.last()) {
+                if (box.contains(*it)) {
+                    this->p = Curve::decode(*it);
                     return;
                 }
-                else if (++miss > miss_threshold) {
+
+                if (++miss > miss_threshold) {
                     miss = 0;
-                    auto bmin = bigmin(*it, zmin, zmax);
-                    auto range = super->pgm.search(bmin);
-                    it = std::upper_bound(super->data.begin() + range.lo, super->data.begin() + range.hi, bmin);
-                    --it;
-                }
-                ++it;
+                    auto next = box.next(*it);
+                    auto range = super->pgm.search(next);
+                    it = std::lower_bound(super->data.begin() + range.lo, super->data.begin() + range.hi, next);
+                } else
+                    ++it;
             }
 
-            if (*it > zmax)
-                it = super->data.end();
+            it = super->data.end();
         }
 
     public:
 
-        RangeIterator(internal_iterator it) : RangeIterator(it, morton::Decode(*it)) {}
+        RangeIterator(const decltype(super) super, internal_iterator it)
+            : RangeIterator(super, it, Curve::decode(*it)) {}
 
-        RangeIterator(internal_iterator it, const value_type &p) : p(p), it(it), miss(-1) {}
+        RangeIterator(const decltype(super) super, internal_iterator it, const value_type &p)
+            : super(super), p(p), it(it), miss(-1) {}
 
         RangeIterator(const decltype(super) super, const value_type &min, const value_type &max)
             : super(super),
-              min(min),
-              max(max),
-              zmin(multidimensional_pgm_type::encode(min)),
-              zmax(multidimensional_pgm_type::encode(max)),
+              box(min, max),
               miss(0) {
-            if (zmin > zmax)
+            if (!box_valid(min, max, std::make_index_sequence<Dimensions>()))
                 throw std::invalid_argument("min > max");
 
-            auto range = super->pgm.search(zmin);
-            this->it = std::lower_bound(super->data.begin() + range.lo, super->data.begin() + range.hi, zmin);
+            auto range = super->pgm.search(box.first());
+            this->it = std::lower_bound(super->data.begin() + range.lo, super->data.begin() + range.hi, box.first());
             if (this->it == super->data.end())
                 return;
 
-            if (box_zcontains(zmin, zmax, *this->it))
-                this->p = morton::Decode(*this->it);
+            if (box.contains(*this->it))
+                this->p = Curve::decode(*this->it);
             else
                 advance();
         }
@@ -1136,87 +1861,650 @@ private:
         }
 
         RangeIterator operator++(int) {
-            RangeIterator i(this->super, min, max);
-            i.it = this->it;
-            i.advance();
+            RangeIterator i(*this);
+            advance();
             return i;
         }
 
         reference operator*() const { return p; }
         pointer operator->() const { return &p; };
+
+        /** Returns the payload of the element pointed by the iterator. Requires the container to have payloads. */
+        template<typename U = V>
+        const U &payload() const { return super->payload[std::distance(super->data.begin(), it)]; }
         bool operator==(const iterator &rhs) const { return it == rhs.it; }
         bool operator!=(const iterator &rhs) const { return it != rhs.it; }
     };
 
     template<typename Head, typename... Tail>
     constexpr static T encode(const std::tuple<Head, Tail...> &t) {
-        return apply([](const auto &head, const auto &... tail) { return morton::Encode(head, tail...); }, t);
+        return apply([](const auto &head, const auto &... tail) { return Curve::encode(head, tail...); }, t);
     }
 
     template<typename T1, typename T2>
     constexpr static T encode(const std::pair<T1, T2> &t) { return encode(std::tuple<T1, T2>(t.first, t.second)); }
 
     template<size_t ...I>
-    constexpr static bool box_zcontains_field(const T &min, const T &max, const T &p, std::index_sequence<I...>) {
-        return (((min & (selector << I)) <= (p & (selector << I))
-            && (p & (selector << I)) <= (max & (selector << I))) && ... );
+    static bool box_valid(const value_type &min, const value_type &max, std::index_sequence<I...>) {
+        return ((std::get<I>(min) <= std::get<I>(max)) && ...);
     }
 
     /**
-     * Returns @c true if and only if the given element @p p lies inside the hyperrectangle defined by the extremes
-     * @p min and @p max.
+     * Writes to data the codes of the elements in the range starting at @p first, in the same order.
      */
-    constexpr static bool box_zcontains(const T &min, const T &max, const T &p) {
-        return box_zcontains_field(min, max, p, std::make_index_sequence<Dimensions>());
+    template<typename RandomIt>
+    void encode_all(RandomIt first) {
+        auto n = data.size();
+        auto invalid = n;
+
+        // Encode blocks of elements in parallel, transposing their fields to feed the batch encoder of the curve
+        #pragma omp parallel for schedule(static)
+        for (size_t begin = 0; begin < n; begin += encode_block_size) {
+            typename Curve::field_type fields[Dimensions][encode_block_size];
+            auto size = std::min<size_t>(encode_block_size, n - begin);
+            for (size_t j = 0; j < size; ++j) {
+                if (!transpose(first[begin + j], fields, j, std::make_index_sequence<Dimensions>())) {
+                    #pragma omp critical
+                    invalid = std::min(invalid, begin + j);
+                }
+            }
+            Curve::encode_batch(field_pointers(fields, std::make_index_sequence<Dimensions>()), size, &data[begin]);
+        }
+
+        if (invalid < n) {
+            auto tuple_str = std::apply([](auto &...x) { return ((std::to_string(x) + ",") + ...); }, first[invalid]);
+            throw std::runtime_error("Type is too small to encode (" + tuple_str + "\b)");
+        }
+    }
+
+    /** Returns @c true if no field of @p p is too large to encode. */
+    static bool encodable(const value_type &p) {
+        return std::apply([](auto... x) { return ((size_t(BIT_WIDTH(x)) < Curve::field_bits) && ...); }, p);
     }
 
     /**
-     * Loads @p pattern into the bits of @p target associated to the given @p dimension, starting at @p bit_position,
-     * leaving the other bits untouched.
+     * Copies the fields of @p p to the column @p j of @p fields. Returns @c false if a field is too large to encode.
      */
-    static T load(T target, T pattern, uint8_t bit_position, uint8_t dimension) {
-        auto mask = ~_pdep_u64(sdsl::bits::lo_set[bit_position], selector << dimension);
-        auto pdep = _pdep_u64(pattern, selector << dimension);
-        return (target & mask) | pdep;
+    template<typename P, typename F, size_t ...I>
+    static bool transpose(const P &p, F (&fields)[Dimensions][encode_block_size], size_t j,
+                          std::index_sequence<I...>) {
+        ((fields[I][j] = std::get<I>(p)), ...);
+        return ((size_t(BIT_WIDTH(std::get<I>(p))) < Curve::field_bits) && ...);
+    }
+
+    template<typename F, size_t ...I>
+    static std::array<const F *, Dimensions> field_pointers(F (&fields)[Dimensions][encode_block_size],
+                                                           std::index_sequence<I...>) {
+        return {fields[I]...};
     }
 
     /**
-     * Computes the lowest morton code within the range [@p min, @p max] greater than @p x.
+     * Splits the box [@p min, @p max] in two along the highest bit of the Z-order code in which its extremes differ,
+     * so that all the codes in the lower half precede those in the upper half. Returns @c false if min == max.
      */
-    static T bigmin(const T &xd, const T &min, const T &max) {
-        // http://hermanntropf.de/media/multidimensionalrangequery.pdf
-        T bigmin = 0;
-        T zmin = min;
-        T zmax = max;
-        auto hi_bit = std::max(std::max(sdsl::bits::hi(xd), sdsl::bits::hi(zmin)), sdsl::bits::hi(zmax));
+    template<size_t ...I>
+    static bool split_box(const value_type &min, const value_type &max, value_type &lower_max, value_type &upper_min,
+                          std::index_sequence<I...>) {
+        int level = -1;
+        size_t dimension = 0;
+        auto highest_bit = [&](auto lo, auto hi, size_t i) {
+            int l = BIT_WIDTH(uint64_t(lo ^ hi)) - 1;
+            if (l >= 0 && l >= level) {
+                level = l;
+                dimension = i;
+            }
+        };
+        (highest_bit(std::get<I>(min), std::get<I>(max), I), ...);
+        if (level < 0)
+            return false;
+
+        lower_max = max;
+        upper_min = min;
+        auto split_field = [&](auto &lower_max_field, auto &upper_min_field, size_t i) {
+            if (i == dimension) {
+                upper_min_field = (lower_max_field >> level) << level;
+                lower_max_field = upper_min_field - 1;
+            }
+        };
+        (split_field(std::get<I>(lower_max), std::get<I>(upper_min), I), ...);
+        return true;
+    }
 
-        for (int b = hi_bit; b >= 0; --b) {
-            auto bits = b / Dimensions + 1;
-            auto dim = b % Dimensions;
-            auto decision = uint8_t((((xd >> b) & 1) << 2) | (((zmin >> b) & 1) << 1) | ((zmax >> b) & 1));
-            switch (decision) {
-                case 0b001:
-                    bigmin = load(zmin, T(1) << (bits - 1), bits, dim);
-                    zmax = load(zmax, sdsl::bits::lo_set[bits - 1], bits, dim);
-                    break;
+    /**
+     * Splits the box [@p min, @p max] into sub-boxes spanning disjoint ranges of Z-order codes, enough to keep the
+     * given number of threads busy, and returns their extremes in Z-order.
+     */
+    static std::vector<std::pair<value_type, value_type>> split_box(const value_type &min, const value_type &max,
+                                                                    int parallelism) {
+        if (!box_valid(min, max, std::make_index_sequence<Dimensions>()))
+            throw std::invalid_argument("min > max");
+
+        std::vector<std::pair<value_type, value_type>> boxes{{min, max}};
+        std::vector<std::pair<value_type, value_type>> tmp;
+        auto target = size_t(std::max(parallelism, 1)) * boxes_per_thread;
+        for (auto split = true; split && boxes.size() < target;) {
+            split = false;
+            tmp.clear();
+            for (auto &[lo, hi] : boxes) {
+                value_type lower_max, upper_min;
+                if (split_box(lo, hi, lower_max, upper_min, std::make_index_sequence<Dimensions>())) {
+                    tmp.emplace_back(lo, lower_max);
+                    tmp.emplace_back(upper_min, hi);
+                    split = true;
+                } else
+                    tmp.emplace_back(lo, hi);
+            }
+            boxes.swap(tmp);
+        }
+        return boxes;
+    }
 
-                case 0b011:
-                    bigmin = zmin;
-                    return bigmin;
+    /**
+     * Returns the position of the first element in data[lo, hi) that is not less than @p z.
+     */
+    size_t find_lower_bound(size_t lo, size_t hi, const T &z) const {
+        if (hi - lo > 2 * Epsilon + 2) {
+            auto range = pgm.search(z);
+            lo = std::max(lo, range.lo);
+            hi = std::min(hi, range.hi);
+        }
+        return std::distance(data.begin(), std::lower_bound(data.begin() + lo, data.begin() + hi, z));
+    }
 
-                case 0b100:
-                    return bigmin;
+    /**
+     * Calls @p f(lo, hi) on runs of positions [lo, hi) in data, which together span exactly the elements lying inside
+     * the hyperrectangle defined by the extreme points @p min and @p max.
+     */
+    template<typename F>
+    void for_each_run(const value_type &min, const value_type &max, F f) const {
+        if (!box_valid(min, max, std::make_index_sequence<Dimensions>()))
+            throw std::invalid_argument("min > max");
+        if (data.empty())
+            return;
 
-                case 0b101:
-                    zmin = load(zmin, T(1) << (bits - 1), bits, dim);
-                    break;
+        // If the codes of the box span few elements, scanning them is cheaper than searching the bounds of its cells
+        typename Curve::Box box(min, max);
+        auto lo = find_lower_bound(0, data.size(), box.first());
+        auto hi = std::min(data.size(), lo + count_leaf_size);
+        if (hi == data.size() || data[hi] > box.last())
+            runs_in_range(lo, hi, box, f);
+        else
+            runs_in_box<0>(min, max, f);
+    }
 
-                default:
+    /**
+     * Calls @p f on the runs of elements inside the box [@p min, @p max], after splitting the box along the dimensions
+     * from @p Dimension onwards in which it straddles the boundary of a cell much larger than itself, so that the
+     * descent starts from a cell that encloses the box tightly.
+     */
+    template<size_t Dimension, typename F>
+    void runs_in_box(const value_type &min, const value_type &max, F &f) const {
+        if constexpr (Dimension < Dimensions) {
+            auto lo = std::get<Dimension>(min);
+            auto hi = std::get<Dimension>(max);
+            auto level = BIT_WIDTH(uint64_t(lo ^ hi));
+            if (level > BIT_WIDTH(uint64_t(hi - lo))) {
+                auto lower_max = max;
+                auto upper_min = min;
+                std::get<Dimension>(upper_min) = (hi >> (level - 1)) << (level - 1);
+                std::get<Dimension>(lower_max) = std::get<Dimension>(upper_min) - 1;
+                runs_in_box<Dimension + 1>(min, lower_max, f);
+                runs_in_box<Dimension + 1>(upper_min, max, f);
+            } else
+                runs_in_box<Dimension + 1>(min, max, f);
+        } else {
+            auto level = std::apply([&](auto... lo) {
+                return std::apply([&](auto... hi) { return std::max({0, BIT_WIDTH(uint64_t(lo ^ hi))...}); }, max);
+            }, min);
+            auto bits = level * Dimensions;
+            auto mask = bits >= std::numeric_limits<T>::digits ? ~T(0) : (T(1) << bits) - 1;
+            auto zmin = encode(min) & ~mask;
+            auto lo = find_lower_bound(0, data.size(), zmin);
+            auto hi = (zmin | mask) == std::numeric_limits<T>::max()
+                      ? data.size()
+                      : find_lower_bound(lo, data.size(), (zmin | mask) + 1);
+            if (lo == hi)
+                return;
+
+            Cell cell{zmin, uint8_t(level), lo, hi};
+            if (cell_inside(cell_corner(cell), cell.level, min, max, std::make_index_sequence<Dimensions>()))
+                f(lo, hi);
+            else
+                runs_in_cell(cell, min, max, typename Curve::Box(min, max), f);
+        }
+    }
+
+    /**
+     * Calls @p f on the runs of elements of @p cell, which intersects the box, lying inside the box. The bounds in data
+     * of a child are searched only if the child intersects the box, and those of a cell entirely inside the box are
+     * reported without looking at its elements.
+     */
+    template<typename F>
+    void runs_in_cell(const Cell &cell, const value_type &min, const value_type &max, const typename Curve::Box &box,
+                      F &f) const {
+        if (cell.level > 0 && cell.hi - cell.lo > count_leaf_size) {
+            auto shift = (cell.level - 1) * Dimensions;
+            auto children = T(1) << Dimensions;
+            auto lo = cell.lo;
+            auto lo_child = T(0); // lo is the position of the first element of this child
+            for (T c = 0; c < children; ++c) {
+                Cell child{cell.zmin | (c << shift), uint8_t(cell.level - 1), 0, 0};
+                auto corner = cell_corner(child);
+                if (!cell_intersects(corner, child.level, min, max, std::make_index_sequence<Dimensions>()))
+                    continue;
+                child.lo = lo_child == c ? lo : find_lower_bound(lo, cell.hi, child.zmin);
+                child.hi = c + 1 == children ? cell.hi : find_lower_bound(child.lo, cell.hi, child.zmin + (T(1) << shift));
+                lo = child.hi;
+                lo_child = c + 1;
+                if (child.lo == child.hi)
                     continue;
+                if (cell_inside(corner, child.level, min, max, std::make_index_sequence<Dimensions>()))
+                    f(child.lo, child.hi);
+                else
+                    runs_in_cell(child, min, max, box, f);
             }
+            return;
         }
 
-        return bigmin;
+        runs_in_range(cell.lo, cell.hi, box, f);
+    }
+
+    /**
+     * Calls @p f on the runs of elements in data[lo, hi) lying inside @p box.
+     */
+    template<typename F>
+    void runs_in_range(size_t lo, size_t hi, const typename Curve::Box &box, F &f) const {
+        for (auto i = lo; i < hi;) {
+            for (; i < hi && !box.contains(data[i]); ++i)
+                continue;
+            auto run_begin = i;
+            for (; i < hi && box.contains(data[i]); ++i)
+                continue;
+            if (run_begin != i)
+                f(run_begin, i);
+        }
+    }
+
+    template<size_t ...I>
+    static bool cell_intersects(const value_type &corner, uint8_t level, const value_type &min, const value_type &max,
+                                std::index_sequence<I...>) {
+        auto field = [level](T c, T lo, T hi) { return c <= hi && lo <= c + ((T(1) << level) - 1); };
+        return (field(std::get<I>(corner), std::get<I>(min), std::get<I>(max)) && ...);
+    }
+
+    template<size_t ...I>
+    static bool cell_inside(const value_type &corner, uint8_t level, const value_type &min, const value_type &max,
+                            std::index_sequence<I...>) {
+        auto field = [level](T c, T lo, T hi) { return lo <= c && c + ((T(1) << level) - 1) <= hi; };
+        return (field(std::get<I>(corner), std::get<I>(min), std::get<I>(max)) && ...);
+    }
+
+    /**
+     * Calls @p f on each non-empty child of @p cell, in the order of the curve.
+     */
+    template<typename F>
+    void for_each_child(const Cell &cell, F f) const {
+        auto shift = (cell.level - 1) * Dimensions;
+        auto lo = cell.lo;
+        for (T c = 0; c < (T(1) << Dimensions); ++c) {
+            auto zmin = cell.zmin | (c << shift);
+            auto last_child = c + 1 == (T(1) << Dimensions);
+            auto hi = last_child ? cell.hi : find_lower_bound(lo, cell.hi, zmin + (T(1) << shift));
+            if (lo != hi)
+                f(Cell{zmin, uint8_t(cell.level - 1), lo, hi});
+            lo = hi;
+        }
+    }
+
+    /**
+     * Returns the lowest corner of the hypercube spanned by @p cell.
+     */
+    static value_type cell_corner(const Cell &cell) {
+        auto corner = Curve::decode(cell.zmin);
+        std::apply([&](auto &...x) { ((x &= ~((T(1) << cell.level) - 1)), ...); }, corner);
+        return corner;
+    }
+
+    template<size_t ...I>
+    static distance_type distance_field(const value_type &p, const value_type &min, uint8_t level,
+                                        std::index_sequence<I...>) {
+        auto field = [level](T x, T lo) {
+            T hi = lo + ((T(1) << level) - 1);
+            distance_type d = x < lo ? lo - x : (x > hi ? x - hi : 0);
+            return d * d;
+        };
+        return (field(std::get<I>(p), std::get<I>(min)) + ...);
+    }
+
+    /**
+     * Returns the squared Euclidean distance between @p p and the hypercube of side 2^@p level whose lowest corner is
+     * @p min. With @p level equal to 0, returns the squared distance between @p p and @p min.
+     */
+    static distance_type distance(const value_type &p, const value_type &min, uint8_t level) {
+        return distance_field(p, min, level, std::make_index_sequence<Dimensions>());
+    }
+
+    template<size_t ...I>
+    static bool within_radius(const value_type &a, const value_type &b, const value_type &radius,
+                              std::index_sequence<I...>) {
+        auto field = [](T x, T y, T r) { return (x < y ? y - x : x - y) <= r; };
+        return (field(std::get<I>(a), std::get<I>(b), std::get<I>(radius)) && ...);
+    }
+
+    /**
+     * Enlarges the box [@p min, @p max] to contain the box centred in @p p with half-sides @p radius, clamped to the
+     * values that can be encoded.
+     */
+    template<size_t ...I>
+    static void enlarge(value_type &min, value_type &max, const value_type &p, const value_type &radius,
+                        std::index_sequence<I...>) {
+        constexpr auto field_max = (T(1) << Curve::field_bits) - 1;
+        auto field = [](auto &lo, auto &hi, T x, T r) {
+            lo = std::min<T>(lo, x > r ? x - r : 0);
+            hi = std::max<T>(hi, field_max - x > r ? x + r : field_max);
+        };
+        (field(std::get<I>(min), std::get<I>(max), std::get<I>(p), std::get<I>(radius)), ...);
+    }
+
+    /**
+     * Returns the position of the first code in @p v not less than @p z, searching exponentially from position @p from
+     * in the direction of @p z.
+     */
+    static size_t gallop(const std::vector<T> &v, size_t from, const T &z) {
+        size_t step = 1;
+        if (from < v.size() && v[from] < z) {
+            auto lo = from;
+            while (lo + step < v.size() && v[lo + step] < z) {
+                lo += step;
+                step *= 2;
+            }
+            auto hi = std::min(lo + step, v.size());
+            return std::distance(v.begin(), std::lower_bound(v.begin() + lo + 1, v.begin() + hi, z));
+        }
+
+        auto hi = from;
+        while (hi >= step && v[hi - step] >= z) {
+            hi -= step;
+            step *= 2;
+        }
+        auto lo = hi >= step ? hi - step : 0;
+        return std::distance(v.begin(), std::lower_bound(v.begin() + lo, v.begin() + hi, z));
+    }
+
+    template<typename F, typename Predicate>
+    void join_with(const MultidimensionalPGMIndex &other, F &f, const value_type &radius, Predicate matches) const {
+        if (data.empty() || other.data.empty())
+            return;
+        std::vector<value_type> buffer;
+        size_t cursor = 0;
+        join_cell(Cell{0, Curve::field_bits, 0, data.size()}, other, f, radius, matches, buffer, cursor);
+    }
+
+    /**
+     * Joins the elements of @p cell with those of @p other, moving @p cursor on the codes of @p other. The cell is
+     * skipped if the range of codes of its hypercube enlarged by @p radius contains no code of @p other, and it is split
+     * into its children until it is small enough. Then, the codes of @p other inside the bounding box of its elements,
+     * enlarged by @p radius, are scanned and compared with each element of the cell.
+     */
+    template<typename F, typename Predicate>
+    void join_cell(const Cell &cell, const MultidimensionalPGMIndex &other, F &f, const value_type &radius,
+                   Predicate &matches, std::vector<value_type> &buffer, size_t &cursor) const {
+        if (cell.level < Curve::field_bits) {
+            auto min = cell_corner(cell);
+            auto max = min;
+            std::apply([&](auto &...x) { ((x += (T(1) << cell.level) - 1), ...); }, max);
+            enlarge(min, max, min, radius, std::make_index_sequence<Dimensions>());
+            enlarge(min, max, max, radius, std::make_index_sequence<Dimensions>());
+            typename Curve::Box box(min, max);
+            cursor = gallop(other.data, cursor, box.first());
+            if (cursor == other.data.size() || other.data[cursor] > box.last())
+                return;
+        }
+
+        if (cell.level > 0 && cell.hi - cell.lo > join_leaf_size) {
+            for_each_child(cell, [&](const Cell &child) {
+                join_cell(child, other, f, radius, matches, buffer, cursor);
+            });
+            return;
+        }
+
+        buffer.clear();
+        for (auto i = cell.lo; i < cell.hi; ++i)
+            buffer.push_back(Curve::decode(data[i]));
+
+        value_type min = buffer.front();
+        value_type max = buffer.front();
+        for (auto &p : buffer)
+            enlarge(min, max, p, radius, std::make_index_sequence<Dimensions>());
+
+        typename Curve::Box box(min, max);
+        cursor = gallop(other.data, cursor, box.first());
+        auto misses = 0;
+        for (auto i = cursor; i < other.data.size() && other.data[i] <= box.last();) {
+            if (!box.contains(other.data[i])) {
+                if (++misses > miss_threshold) {
+                    misses = 0;
+                    i = gallop(other.data, i, box.next(other.data[i]));
+                } else
+                    ++i;
+                continue;
+            }
+
+            auto q = Curve::decode(other.data[i++]);
+            for (auto &p : buffer)
+                if (matches(p, q))
+                    f(p, q);
+        }
+    }
+};
+
+
+/**
+ * A multidimensional associative container that supports insertions, deletions and orthogonal range queries.
+ *
+ * The elements are mapped to codes by the space-filling curve given by the @p Curve policy and stored in the levels of
+ * a @ref DynamicPGMIndex. A range query scans each level skipping the runs of codes that fall outside the query
+ * hyperrectangle, as in @ref MultidimensionalPGMIndex, and then merges the results of the levels so that the most
+ * recent insertion or deletion of an element prevails.
+ *
+ * @tparam Dimensions the number of fields/dimensions
+ * @tparam T the type of the fields of the stored elements
+ * @tparam V the type of a value
+ * @tparam PGMType the type of @ref PGMIndex to use in the levels of the container
+ * @tparam Curve the space-filling curve that maps the elements to codes
+ */
+template<uint8_t Dimensions, typename T, typename V, typename PGMType = PGMIndex<T, 16>,
+         typename Curve = MortonCurve<Dimensions, T>>
+class DynamicMultidimensionalPGMIndex {
+    using dynamic_pgm_type = DynamicPGMIndex<T, V, PGMType>;
+    using Item = typename dynamic_pgm_type::Item;
+    using Level = typename dynamic_pgm_type::Level;
+
+    dynamic_pgm_type index;
+
+    static constexpr auto miss_threshold = 64;
+
+public:
+
+    using mapped_type = V;
+    using size_type = size_t;
+    using value_type = typename Curve::value_type;
+
+    /**
+     * Constructs an empty container.
+     * @param base determines the size of the ith level as base^i
+     * @param buffer_level determines the size of level 0, equal to the sum of base^i for i = 0, ..., buffer_level
+     * @param index_level the minimum level at which an index is constructed to speed up searches
+     */
+    DynamicMultidimensionalPGMIndex(uint8_t base = 8, uint8_t buffer_level = 0, uint8_t index_level = 0)
+        : index(base, buffer_level, index_level) {}
+
+    /**
+     * Constructs the container with the element-value pairs in the range [first, last). If an element occurs more
+     * than once, only its first occurrence is kept.
+     * @param first, last the range containing the element-value pairs to be indexed
+     * @param base determines the size of the ith level as base^i
+     * @param buffer_level determines the size of level 0, equal to the sum of base^i for i = 0, ..., buffer_level
+     * @param index_level the minimum level at which an index is constructed to speed up searches
+     */
+    template<typename Iterator>
+    DynamicMultidimensionalPGMIndex(Iterator first, Iterator last, uint8_t base = 8, uint8_t buffer_level = 0,
+                                    uint8_t index_level = 0)
+        : DynamicMultidimensionalPGMIndex(encode_sorted(first, last), base, buffer_level, index_level) {}
+
+    /**
+     * Inserts the element @p p into the container with the given @p value. If @p p already exists, the corresponding
+     * value is updated with @p value.
+     * @param p element to insert or update
+     * @param value element value to insert
+     */
+    void insert_or_assign(const value_type &p, const V &value) { index.insert_or_assign(encode(p), value); }
+
+    /**
+     * Removes the specified element from the container.
+     * @param p the element to remove
+     */
+    void erase(const value_type &p) { index.erase(encode(p)); }
+
+    /**
+     * Checks if there is an element equal to @p p in the container.
+     * @param p the element to search for
+     * @return @c true if there is such an element, @c false otherwise
+     */
+    bool contains(const value_type &p) const { return index.find(encode(p)) != index.end(); }
+
+    /**
+     * Returns a copy of the elements lying inside the hyperrectangle defined by the extreme points @p min and @p max,
+     * together with their values, in the order of the curve.
+     * @param min the lower extreme of the query hyperrectangle
+     * @param max the upper extreme of the query hyperrectangle, must be greater than or equal to min
+     * @return a vector of element-value pairs satisfying the range query
+     */
+    std::vector<std::pair<value_type, V>> range(const value_type &min, const value_type &max) const {
+        if (!box_valid(min, max, std::make_index_sequence<Dimensions>()))
+            throw std::invalid_argument("min > max");
+
+        typename Curve::Box box(min, max);
+        Level selected;
+        Level tmp_a;
+        Level tmp_b;
+        auto alternate = true;
+
+        for (auto i = index.min_level; i < index.used_levels; ++i) {
+            if (index.level(i).empty())
+                continue;
+
+            selected.clear();
+            range_level(i, box, selected);
+            if (selected.empty())
+                continue;
+
+            auto &in = alternate ? tmp_a : tmp_b;
+            auto &out = alternate ? tmp_b : tmp_a;
+            out.resize(in.size() + selected.size());
+            auto out_end = dynamic_pgm_type::template merge<false, false>(in.begin(), in.end(), selected.begin(),
+                                                                         selected.end(), out.begin());
+            out.resize(std::distance(out.begin(), out_end));
+            alternate = !alternate;
+        }
+
+        std::vector<std::pair<value_type, V>> result;
+        auto &merged = alternate ? tmp_a : tmp_b;
+        result.reserve(merged.size());
+        for (auto &item : merged)
+            if (!item.deleted())
+                result.emplace_back(Curve::decode(T(item.first)), item.second);
+        return result;
+    }
+
+    /**
+     * Checks if the container has no elements.
+     * @return true if the container is empty, false otherwise
+     */
+    bool empty() const { return index.empty(); }
+
+    /**
+     * Returns the number of elements in the container.
+     * @return the number of elements in the container
+     */
+    size_t size() const { return index.size(); }
+
+    /**
+     * Returns the size of the container (data + index structure) in bytes.
+     * @return the size of the container in bytes
+     */
+    size_t size_in_bytes() const { return index.size_in_bytes(); }
+
+    /**
+     * Returns the size of the index used in this container in bytes.
+     * @return the size of the index used in this container in bytes
+     */
+    size_t index_size_in_bytes() const { return index.index_size_in_bytes(); }
+
+private:
+
+    DynamicMultidimensionalPGMIndex(const std::vector<std::pair<T, V>> &data, uint8_t base, uint8_t buffer_level,
+                                    uint8_t index_level)
+        : index(data.begin(), data.end(), base, buffer_level, index_level) {}
+
+    /**
+     * Returns the codes of the element-value pairs in the range [first, last), stably sorted by code.
+     */
+    template<typename Iterator>
+    static std::vector<std::pair<T, V>> encode_sorted(Iterator first, Iterator last) {
+        std::vector<std::pair<T, V>> data;
+        data.reserve(std::distance(first, last));
+        std::for_each(first, last, [&](const auto &x) { data.emplace_back(encode(x.first), x.second); });
+        std::stable_sort(data.begin(), data.end(), [](auto &a, auto &b) { return a.first < b.first; });
+        return data;
+    }
+
+    /**
+     * Appends to @p out the items of the given level whose code lies inside @p box, including deleted ones.
+     */
+    void range_level(uint8_t i, const typename Curve::Box &box, Level &out) const {
+        auto &level = index.level(i);
+        auto lower_bound = [&](auto first, const T &z) {
+            auto last = level.end();
+            if (index.has_pgm(i)) {
+                auto range = index.pgm(i).search(z);
+                first = std::max(first, level.begin() + range.lo);
+                last = std::max(first, level.begin() + range.hi);
+            }
+            return dynamic_pgm_type::lower_bound_bl(first, last, z);
+        };
+
+        auto miss = 0;
+        auto it = lower_bound(level.begin(), box.first());
+        while (it != level.end() && it->first <= box.last()) {
+            T code = it->first; // copied, as items are packed and it->first may be misaligned
+            if (box.contains(code)) {
+                out.push_back(*it++);
+                continue;
+            }
+
+            if (++miss > miss_threshold) {
+                miss = 0;
+                it = lower_bound(it, box.next(code));
+            } else
+                ++it;
+        }
+    }
+
+    template<typename P>
+    static T encode(const P &p) {
+        return std::apply([](auto... x) {
+            if (((size_t(BIT_WIDTH(x)) >= Curve::field_bits) || ...)) {
+                auto tuple_str = ((std::to_string(x) + ",") + ...);
+                throw std::runtime_error("Type is too small to encode (" + tuple_str + "\b)");
+            }
+            return Curve::encode(x...);
+        }, p);
+    }
+
+    template<size_t ...I>
+    static bool box_valid(const value_type &min, const value_type &max, std::index_sequence<I...>) {
+        return ((std::get<I>(min) <= std::get<I>(max)) && ...);
     }
 };
 
@@ -35,10 +35,95 @@
 
 namespace pgm::internal {
 
+/**
+ * A minimal signed 256-bit integer in two's complement, used to compute exactly the slopes and the cross products of
+ * points with 128-bit coordinates.
+ */
+class Int256 {
+    __uint128_t lo; ///< The low 128 bits.
+    __int128 hi;    ///< The high 128 bits, carrying the sign.
+
+    constexpr Int256(__int128 hi, __uint128_t lo) : lo(lo), hi(hi) {}
+
+    constexpr bool negative() const { return hi < 0; }
+    constexpr Int256 abs() const { return negative() ? -*this : *this; }
+
+    static constexpr __uint128_t mul_hi(__uint128_t a, __uint128_t b) {
+        auto a_lo = uint64_t(a), a_hi = uint64_t(a >> 64);
+        auto b_lo = uint64_t(b), b_hi = uint64_t(b >> 64);
+        auto lo_lo = __uint128_t(a_lo) * b_lo;
+        auto hi_lo = __uint128_t(a_hi) * b_lo;
+        auto lo_hi = __uint128_t(a_lo) * b_hi;
+        auto mid = (lo_lo >> 64) + uint64_t(hi_lo) + uint64_t(lo_hi);
+        return __uint128_t(a_hi) * b_hi + (hi_lo >> 64) + (lo_hi >> 64) + (mid >> 64);
+    }
+
+public:
+
+    constexpr Int256() : lo(), hi() {}
+
+    template<typename T, std::enable_if_t<std::is_integral_v<T>, int> = 0>
+    constexpr Int256(T x) : lo(__uint128_t(x)), hi(std::is_signed_v<T> && x < 0 ? -1 : 0) {}
+
+    constexpr explicit operator __int128() const { return __int128(lo); }
+
+    explicit operator long double() const {
+        auto x = abs();
+        auto value = (long double) __uint128_t(x.hi) * 0x1p128L + (long double) x.lo;
+        return negative() ? -value : value;
+    }
+
+    constexpr Int256 operator-() const { return Int256(~hi + (lo == 0), ~lo + 1); }
+
+    friend constexpr Int256 operator+(const Int256 &a, const Int256 &b) {
+        auto lo = a.lo + b.lo;
+        return {__int128(__uint128_t(a.hi) + __uint128_t(b.hi) + (lo < a.lo)), lo};
+    }
+
+    friend constexpr Int256 operator-(const Int256 &a, const Int256 &b) { return a + -b; }
+
+    friend constexpr Int256 operator*(const Int256 &a, const Int256 &b) {
+        auto hi = mul_hi(a.lo, b.lo) + __uint128_t(a.hi) * b.lo + a.lo * __uint128_t(b.hi);
+        return {__int128(hi), a.lo * b.lo};
+    }
+
+    /** Truncated division, computed by long division on the absolute values. */
+    friend constexpr Int256 operator/(const Int256 &a, const Int256 &b) {
+        auto n = a.abs();
+        auto d = b.abs();
+        Int256 q;
+        Int256 r;
+        for (int i = 255; i >= 0; --i) {
+            auto bit = i >= 128 ? (__uint128_t(n.hi) >> (i - 128)) & 1 : (n.lo >> i) & 1;
+            r = Int256(__int128((__uint128_t(r.hi) << 1) | (r.lo >> 127)), (r.lo << 1) | bit);
+            if (!(r < d)) {
+                r = r - d;
+                if (i >= 128)
+                    q.hi = __int128(__uint128_t(q.hi) | (__uint128_t(1) << (i - 128)));
+                else
+                    q.lo |= __uint128_t(1) << i;
+            }
+        }
+        return a.negative() != b.negative() ? -q : q;
+    }
+
+    friend constexpr bool operator<(const Int256 &a, const Int256 &b) {
+        return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo);
+    }
+
+    friend constexpr bool operator==(const Int256 &a, const Int256 &b) { return a.hi == b.hi && a.lo == b.lo; }
+    friend constexpr bool operator!=(const Int256 &a, const Int256 &b) { return !(a == b); }
+    friend constexpr bool operator>(const Int256 &a, const Int256 &b) { return b < a; }
+    friend constexpr bool operator<=(const Int256 &a, const Int256 &b) { return !(b < a); }
+    friend constexpr bool operator>=(const Int256 &a, const Int256 &b) { return !(a < b); }
+};
+
 template<typename T>
 using LargeSigned = typename std::conditional_t<std::is_floating_point_v<T>,
                                                 long double,
-                                                std::conditional_t<(sizeof(T) < 8), int64_t, __int128>>;
+                                                std::conditional_t<(sizeof(T) < 8), int64_t,
+                                                                   std::conditional_t<(sizeof(T) <= 8),
+                                                                                      __int128, Int256>>>;
 
 template<typename X, typename Y>
 class OptimalPiecewiseLinearModel {
@@ -251,14 +336,14 @@ public:
             auto intercept_d = slope.dx;
             auto rounding_term = ((intercept_n < 0) ^ (intercept_d < 0) ? -1 : +1) * intercept_d / 2;
             auto intercept = (intercept_n + rounding_term) / intercept_d + rectangle[1].y;
-            return {static_cast<long double>(slope), intercept};
+            return {static_cast<long double>(slope), SY(intercept)};
+        } else {
+            auto[i_x, i_y] = get_intersection();
+            auto[min_slope, max_slope] = get_slope_range();
+            auto slope = (min_slope + max_slope) / 2.;
+            auto intercept = i_y - (i_x - origin) * slope;
+            return {slope, intercept};
         }
-
-        auto[i_x, i_y] = get_intersection();
-        auto[min_slope, max_slope] = get_slope_range();
-        auto slope = (min_slope + max_slope) / 2.;
-        auto intercept = i_y - (i_x - origin) * slope;
-        return {slope, intercept};
     }
 
     std::pair<long double, long double> get_slope_range() const {
@@ -300,13 +385,25 @@ size_t make_segmentation(size_t n, size_t epsilon, Fin in, Fout out) {
     return ++c;
 }
 
+/**
+ * Returns the number of chunks, each segmented by its own thread, that make_segmentation_par() splits @p n points into
+ * with the current OpenMP settings.
+ * @param n the number of points
+ * @return the number of chunks, 1 if the segmentation is sequential
+ */
+inline int segmentation_chunks(size_t n) {
+    if (n < 1ull << 15)
+        return 1;
+    return std::min(std::min(omp_get_num_procs(), omp_get_max_threads()), 20);
+}
+
 template<typename Fin, typename Fout>
 size_t make_segmentation_par(size_t n, size_t epsilon, Fin in, Fout out) {
-    auto parallelism = std::min(std::min(omp_get_num_procs(), omp_get_max_threads()), 20);
+    auto parallelism = segmentation_chunks(n);
     auto chunk_size = n / parallelism;
     auto c = 0ull;
 
-    if (parallelism == 1 || n < 1ull << 15)
+    if (parallelism == 1)
         return make_segmentation(n, epsilon, in, out);
 
     using X = typename std::invoke_result_t<Fin, size_t>::first_type;
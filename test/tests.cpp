@@ -22,6 +22,7 @@
 #include "utils.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <cstdio>
 #include <cmath>
@@ -99,6 +100,14 @@ TEMPLATE_TEST_CASE_SIG("Compressed PGM-index", "", ((size_t E), E), 8, 32, 128)
     test_index(index, data);
 }
 
+TEST_CASE("Compressed PGM-index with a single segment", "") {
+    auto data = generate_data<uint32_t>(10000);
+    pgm::CompressedPGMIndex<uint32_t, 16384> index(data);
+    REQUIRE(index.segments_count() == 1);
+    REQUIRE(index.height() == 1);
+    test_index(index, data);
+}
+
 TEMPLATE_TEST_CASE_SIG("Bucketing PGM-index", "",
                        ((size_t E, size_t S), E, S), (4, 128), (8, 100), (4, 512), (8, 550)) {
     auto data = generate_data<uint32_t>(2000000);
@@ -168,6 +177,7 @@ TEMPLATE_TEST_CASE("Dynamic PGM-index", "", uint32_t*, uint32_t, std::string) {
     using PGMType = pgm::PGMIndex<uint32_t>;
     pgm::DynamicPGMIndex<uint32_t, TestType, PGMType> pgm(bulk.begin(), bulk.end(), GENERATE(2, 4, 8));
     std::map<uint32_t, TestType> map(bulk.begin(), bulk.end());
+    REQUIRE(pgm.merge_stats().merges == 0);
 
     // Test initial state
     auto it1 = pgm.begin();
@@ -200,6 +210,7 @@ TEMPLATE_TEST_CASE("Dynamic PGM-index", "", uint32_t*, uint32_t, std::string) {
         map.insert_or_assign(k, v);
     }
     REQUIRE(pgm.size() == map.size());
+    REQUIRE(pgm.merge_stats().merges > 0);
 
     // Test for most recent values
     for (size_t i = 0; i < std::min<size_t>(10000, bulk.size()); ++i) {
@@ -273,6 +284,332 @@ TEMPLATE_TEST_CASE_SIG("Multidimensional PGM-index", "",
     }
 }
 
+TEMPLATE_TEST_CASE_SIG("Multidimensional PGM-index parallel range", "",
+                       ((typename T, uint8_t D), T, D),
+                       (uint32_t, 2), (uint32_t, 3), (uint64_t, 2), (uint64_t, 3), (uint64_t, 4)) {
+    auto u = 1ull << (std::numeric_limits<T>::digits / D - 2);
+    auto rand = std::bind(std::uniform_int_distribution<T>(0, u), std::mt19937{42});
+    auto rand_tuple = [&] { return make_rand_tuple(rand, std::make_index_sequence<D>()); };
+
+    std::vector<decltype(rand_tuple())> data(100000);
+    std::generate(data.begin(), data.end(), rand_tuple);
+    pgm::MultidimensionalPGMIndex<D, T, 16> pgm(data.begin(), data.end());
+
+    for (int i = 0; i < 100; ++i) {
+        auto min = rand_tuple();
+        auto max = i == 0 ? min : min + rand_tuple();
+        std::vector<decltype(min)> expected(pgm.range(min, max), pgm.end());
+
+        std::vector<decltype(min)> result;
+        for (auto &chunk : pgm.range_par(min, max, GENERATE(1, 4)))
+            result.insert(result.end(), chunk.begin(), chunk.end());
+        REQUIRE(result == expected);
+
+        std::atomic<size_t> count{0};
+        pgm.range_for_each_par(min, max, [&](auto &) { ++count; });
+        REQUIRE(count == expected.size());
+    }
+}
+
+TEMPLATE_TEST_CASE_SIG("Multidimensional PGM-index range count", "",
+                       ((typename T, uint8_t D), T, D),
+                       (uint32_t, 2), (uint32_t, 3), (uint64_t, 2), (uint64_t, 3), (uint64_t, 4)) {
+    auto u = 1ull << (std::numeric_limits<T>::digits / D - 2);
+    auto rand = std::bind(std::uniform_int_distribution<T>(0, u), std::mt19937{42});
+    auto rand_tuple = [&] { return make_rand_tuple(rand, std::make_index_sequence<D>()); };
+
+    std::vector<decltype(rand_tuple())> data(100000);
+    std::generate(data.begin(), data.end(), rand_tuple);
+    pgm::MultidimensionalPGMIndex<D, T, 16> morton_pgm(data.begin(), data.end());
+    pgm::MultidimensionalPGMIndex<D, T, 16, 4, float, pgm::HilbertCurve<D, T>> hilbert_pgm(data.begin(), data.end());
+
+    for (int i = 0; i < 200; ++i) {
+        auto min = rand_tuple();
+        auto max = i == 0 ? min : min + make_rand_tuple([&](size_t) { return rand() >> (i % 8); },
+                                                        std::make_index_sequence<D>());
+        auto expected_count = std::distance(morton_pgm.range(min, max), morton_pgm.end());
+        REQUIRE(morton_pgm.range_count(min, max) == size_t(expected_count));
+        REQUIRE(hilbert_pgm.range_count(min, max) == size_t(expected_count));
+    }
+
+    auto max = make_rand_tuple([&](size_t) { return T(u + u); }, std::make_index_sequence<D>());
+    REQUIRE(morton_pgm.range_count(decltype(max)(), max) == data.size());
+}
+
+TEMPLATE_TEST_CASE_SIG("Multidimensional PGM-index with payloads", "",
+                       ((typename T, uint8_t D), T, D),
+                       (uint32_t, 2), (uint32_t, 3), (uint64_t, 2), (uint64_t, 3)) {
+    auto u = 1ull << (std::numeric_limits<T>::digits / D - 2);
+    auto rand = std::bind(std::uniform_int_distribution<T>(0, u), std::mt19937{42});
+    auto rand_tuple = [&] { return make_rand_tuple(rand, std::make_index_sequence<D>()); };
+
+    std::vector<decltype(rand_tuple())> data(100000);
+    std::generate(data.begin(), data.end(), rand_tuple);
+    std::sort(data.begin(), data.end());
+    data.erase(std::unique(data.begin(), data.end()), data.end());
+    std::shuffle(data.begin(), data.end(), std::mt19937{42});
+
+    std::vector<uint64_t> payloads(data.size());
+    std::map<decltype(rand_tuple()), uint64_t> expected_payload;
+    for (size_t i = 0; i < data.size(); ++i) {
+        payloads[i] = rand() % 1000000;
+        expected_payload[data[i]] = payloads[i];
+    }
+
+    pgm::MultidimensionalPGMIndex<D, T, 16, 4, float, pgm::MortonCurve<D, T>, uint64_t>
+        pgm(data.begin(), data.end(), payloads.begin());
+
+    for (auto it = pgm.begin(); it != pgm.end(); ++it)
+        REQUIRE(it.payload() == expected_payload[*it]);
+
+    for (int i = 0; i < 200; ++i) {
+        auto min = rand_tuple();
+        auto max = min + rand_tuple();
+        uint64_t expected_sum = 0;
+        uint64_t expected_max = 0;
+        for (auto it = pgm.range(min, max); it != pgm.end(); ++it) {
+            REQUIRE(it.payload() == expected_payload[*it]);
+            expected_sum += it.payload();
+            expected_max = std::max(expected_max, it.payload());
+        }
+        REQUIRE(pgm.range_sum(min, max) == expected_sum);
+        auto max_payload = [](uint64_t a, uint64_t b) { return std::max(a, b); };
+        REQUIRE(pgm.range_aggregate(min, max, uint64_t(0), max_payload) == expected_max);
+    }
+
+    decltype(pgm) no_payloads(data.begin(), data.end());
+    for (auto it = no_payloads.begin(); it != no_payloads.end(); ++it)
+        REQUIRE(it.payload() == 0);
+    auto max = make_rand_tuple([&](size_t) { return T(u + u); }, std::make_index_sequence<D>());
+    REQUIRE(no_payloads.range_sum(decltype(max)(), max) == 0);
+}
+
+TEMPLATE_TEST_CASE_SIG("Multidimensional PGM-index kNN", "",
+                       ((typename T, uint8_t D), T, D),
+                       (uint32_t, 2), (uint32_t, 3), (uint64_t, 2), (uint64_t, 3), (uint64_t, 4)) {
+    auto u = 1ull << (std::numeric_limits<T>::digits / D - 2);
+    auto rand = std::bind(std::uniform_int_distribution<T>(0, u), std::mt19937{42});
+    auto rand_tuple = [&] { return make_rand_tuple(rand, std::make_index_sequence<D>()); };
+
+    std::vector<decltype(rand_tuple())> data(GENERATE(10, 100000));
+    std::generate(data.begin(), data.end(), rand_tuple);
+    pgm::MultidimensionalPGMIndex<D, T, 16> pgm(data.begin(), data.end());
+
+    std::vector<long double> distances(data.size());
+    for (int i = 0; i < 50; ++i) {
+        auto p = rand_tuple();
+        auto k = size_t(1) << (i % 8);
+        auto result = pgm.knn(p, k);
+        std::transform(data.begin(), data.end(), distances.begin(), [&](auto &x) { return squared_distance(p, x); });
+        std::sort(distances.begin(), distances.end());
+        REQUIRE(result.size() == std::min(k, data.size()));
+        for (size_t j = 0; j < result.size(); ++j)
+            REQUIRE(squared_distance(p, result[j]) == distances[j]);
+    }
+
+    auto out_of_domain = rand_tuple();
+    std::get<D - 1>(out_of_domain) = std::numeric_limits<T>::max();
+    REQUIRE_THROWS_AS(pgm.knn(out_of_domain, 1), std::runtime_error);
+}
+
+TEMPLATE_TEST_CASE_SIG("Multidimensional PGM-index spatial join", "",
+                       ((typename T, uint8_t D), T, D),
+                       (uint32_t, 2), (uint32_t, 3), (uint64_t, 2), (uint64_t, 3)) {
+    auto u = T(1) << std::min(12, std::numeric_limits<T>::digits / D - 2);
+    auto rand = std::bind(std::uniform_int_distribution<T>(0, u), std::mt19937{42});
+    auto rand_tuple = [&] { return make_rand_tuple(rand, std::make_index_sequence<D>()); };
+
+    std::vector<decltype(rand_tuple())> left(1000);
+    std::vector<decltype(rand_tuple())> right(2000);
+    std::generate(left.begin(), left.end(), rand_tuple);
+    std::generate(right.begin(), right.end(), rand_tuple);
+    pgm::MultidimensionalPGMIndex<D, T, 16> left_pgm(left.begin(), left.end());
+    pgm::MultidimensionalPGMIndex<D, T, 16> right_pgm(right.begin(), right.end());
+    std::sort(left.begin(), left.end());
+    std::sort(right.begin(), right.end());
+
+    using pair_type = std::pair<decltype(rand_tuple()), decltype(rand_tuple())>;
+    auto check = [&](auto join, auto matches) {
+        std::vector<pair_type> result;
+        join([&](auto &a, auto &b) { result.emplace_back(a, b); });
+        std::vector<pair_type> expected;
+        for (auto &a : left)
+            for (auto &b : right)
+                if (matches(a, b))
+                    expected.emplace_back(a, b);
+        std::sort(result.begin(), result.end());
+        REQUIRE(!expected.empty());
+        REQUIRE(result == expected);
+    };
+
+    auto radius = make_rand_tuple([&](auto i) { return T(u / 64 * (i + 1)); }, std::make_index_sequence<D>());
+    check([&](auto f) { left_pgm.join(right_pgm, radius, f); },
+          [&](auto &a, auto &b) { return box_contains(a, a + radius + radius, b + radius); });
+
+    T distance = u / 16 * (D == 2 ? 1 : 4);
+    check([&](auto f) { left_pgm.distance_join(right_pgm, distance, f); },
+          [&](auto &a, auto &b) { return squared_distance(a, b) <= (long double) distance * distance; });
+
+    // With right clustered in a corner, the join skips most cells of left
+    for (auto &p : right)
+        std::apply([](auto &...x) { ((x /= 8), ...); }, p);
+    std::sort(right.begin(), right.end());
+    using hilbert_type = pgm::MultidimensionalPGMIndex<D, T, 16, 4, float, pgm::HilbertCurve<D, T>>;
+    hilbert_type left_hilbert(left.begin(), left.end());
+    hilbert_type right_hilbert(right.begin(), right.end());
+    check([&](auto f) { left_hilbert.join(right_hilbert, radius, f); },
+          [&](auto &a, auto &b) { return box_contains(a, a + radius + radius, b + radius); });
+}
+
+TEMPLATE_TEST_CASE_SIG("Multidimensional PGM-index Hilbert curve", "",
+                       ((typename T, uint8_t D), T, D),
+                       (uint32_t, 2), (uint32_t, 3), (uint64_t, 2), (uint64_t, 3), (uint64_t, 4)) {
+    using curve = pgm::HilbertCurve<D, T>;
+    auto u = 1ull << (std::numeric_limits<T>::digits / D - 2);
+    auto rand = std::bind(std::uniform_int_distribution<T>(0, u), std::mt19937{42});
+    auto rand_tuple = [&] { return make_rand_tuple(rand, std::make_index_sequence<D>()); };
+
+    std::vector<decltype(rand_tuple())> data(100000);
+    std::generate(data.begin(), data.end(), rand_tuple);
+    pgm::MultidimensionalPGMIndex<D, T, 16, 4, float, curve> pgm(data.begin(), data.end());
+
+    for (auto p: data) {
+        REQUIRE(pgm.contains(p));
+        REQUIRE(std::apply([](auto... x) { return curve::decode(curve::encode(x...)); }, p) == p);
+    }
+
+    for (int i = 0; i < 200; ++i) {
+        auto min = rand_tuple();
+        auto max = min + rand_tuple();
+        auto count = std::distance(pgm.range(min, max), pgm.end());
+        auto expected_count = 0;
+        for (auto &x : data)
+            expected_count += box_contains(min, max, x);
+        REQUIRE(count == expected_count);
+    }
+
+    std::vector<long double> distances(data.size());
+    for (int i = 0; i < 10; ++i) {
+        auto p = rand_tuple();
+        auto result = pgm.knn(p, 10);
+        std::transform(data.begin(), data.end(), distances.begin(), [&](auto &x) { return squared_distance(p, x); });
+        std::sort(distances.begin(), distances.end());
+        for (size_t j = 0; j < result.size(); ++j)
+            REQUIRE(squared_distance(p, result[j]) == distances[j]);
+    }
+}
+
+TEMPLATE_TEST_CASE_SIG("Multidimensional PGM-index with 128-bit codes", "", ((uint8_t D), D), (2), (3), (4)) {
+    auto u = 1ull << (128 / D - 2);
+    auto rand = std::bind(std::uniform_int_distribution<uint64_t>(0, u), std::mt19937{42});
+    auto rand_tuple = [&] { return make_rand_tuple(rand, std::make_index_sequence<D>()); };
+
+    std::vector<decltype(rand_tuple())> data(100000);
+    std::generate(data.begin(), data.end(), rand_tuple);
+    pgm::MultidimensionalPGMIndex<D, __uint128_t, 16> pgm(data.begin(), data.end());
+
+    for (auto p: data)
+        REQUIRE(pgm.contains(p));
+
+    for (int i = 0; i < 200; ++i) {
+        auto min = rand_tuple();
+        auto max = min + rand_tuple();
+        auto count = std::distance(pgm.range(min, max), pgm.end());
+        auto expected_count = 0;
+        for (auto &x : data)
+            expected_count += box_contains(min, max, x);
+        REQUIRE(count == expected_count);
+    }
+
+    std::vector<long double> distances(data.size());
+    for (int i = 0; i < 10; ++i) {
+        auto p = rand_tuple();
+        auto result = pgm.knn(p, 10);
+        std::transform(data.begin(), data.end(), distances.begin(), [&](auto &x) { return squared_distance(p, x); });
+        std::sort(distances.begin(), distances.end());
+        for (size_t j = 0; j < result.size(); ++j)
+            REQUIRE(squared_distance(p, result[j]) == distances[j]);
+    }
+}
+
+TEMPLATE_TEST_CASE_SIG("Batch Morton encoding", "",
+                       ((typename T, size_t D), T, D),
+                       (uint32_t, 2), (uint32_t, 3), (uint64_t, 2), (uint64_t, 3), (uint64_t, 5)) {
+    using morton = mortonnd::MortonNDBmi<D, T>;
+    using batch = mortonnd::MortonNDBatch<D, T>;
+    auto n = 1000 + 7;
+    auto rand = std::bind(std::uniform_int_distribution<T>(0, (T(1) << (std::numeric_limits<T>::digits / D)) - 1),
+                          std::mt19937{42});
+
+    std::vector<std::vector<T>> fields(D, std::vector<T>(n));
+    std::array<const T *, D> in;
+    std::array<T *, D> out;
+    std::vector<std::vector<T>> decoded(D, std::vector<T>(n));
+    for (size_t i = 0; i < D; ++i) {
+        std::generate(fields[i].begin(), fields[i].end(), rand);
+        in[i] = fields[i].data();
+        out[i] = decoded[i].data();
+    }
+
+    std::vector<T> codes(n);
+    batch::Encode(in, n, codes.data());
+    for (auto j = 0; j < n; ++j) {
+        auto expected = std::apply([](auto... x) { return morton::Encode(x...); },
+                                   make_field_tuple(fields, j, std::make_index_sequence<D>()));
+        REQUIRE(codes[j] == expected);
+    }
+
+    batch::Decode(codes.data(), n, out);
+    REQUIRE(decoded == fields);
+}
+
+TEMPLATE_TEST_CASE_SIG("Dynamic multidimensional PGM-index", "",
+                       ((typename T, uint8_t D), T, D),
+                       (uint32_t, 2), (uint32_t, 3), (uint64_t, 2), (uint64_t, 3), (uint64_t, 4)) {
+    auto u = 1ull << (std::numeric_limits<T>::digits / D - 2);
+    auto rand = std::bind(std::uniform_int_distribution<T>(0, u), std::mt19937{42});
+    auto rand_tuple = [&] { return make_rand_tuple(rand, std::make_index_sequence<D>()); };
+    using point_type = decltype(rand_tuple());
+
+    std::vector<std::pair<point_type, uint32_t>> bulk(GENERATE(0, 100000));
+    for (uint32_t i = 0; i < bulk.size(); ++i)
+        bulk[i] = {rand_tuple(), i};
+    pgm::DynamicMultidimensionalPGMIndex<D, T, uint32_t> pgm(bulk.begin(), bulk.end(), GENERATE(2, 8));
+    std::map<point_type, uint32_t> map;
+    for (auto &[p, v] : bulk)
+        map.emplace(p, v);
+
+    auto check_ranges = [&] {
+        for (int i = 0; i < 50; ++i) {
+            auto min = rand_tuple();
+            auto max = min + rand_tuple();
+            auto result = pgm.range(min, max);
+            std::sort(result.begin(), result.end());
+            std::vector<std::pair<point_type, uint32_t>> expected;
+            for (auto &[p, v] : map)
+                if (box_contains(min, max, p))
+                    expected.emplace_back(p, v);
+            REQUIRE(result == expected);
+        }
+    };
+    check_ranges();
+
+    // Move some points and insert new ones
+    for (uint32_t i = 0; i < 50000; ++i) {
+        if (i < bulk.size() && i % 2) {
+            pgm.erase(bulk[i].first);
+            map.erase(bulk[i].first);
+        }
+        auto p = rand_tuple();
+        pgm.insert_or_assign(p, i);
+        map.insert_or_assign(p, i);
+    }
+    REQUIRE(pgm.size() == map.size());
+    for (size_t i = 0; i < std::min<size_t>(1000, bulk.size()); ++i)
+        REQUIRE(pgm.contains(bulk[i].first) == (map.count(bulk[i].first) == 1));
+    check_ranges();
+}
+
 #endif
 
 TEST_CASE("PGM-index out of bonds", "[tmg]")
@@ -65,10 +65,15 @@ constexpr auto operator+(const std::tuple<T1...>& t1, const std::tuple<T2...>& t
 }
 
 template<typename F, std::size_t... I>
-auto make_rand_tuple(F f, std::index_sequence<I...>) {
+auto make_rand_tuple(F &&f, std::index_sequence<I...>) {
     return std::make_tuple(f(I)...);
 }
 
+template<typename C, std::size_t... I>
+auto make_field_tuple(const C &columns, std::size_t j, std::index_sequence<I...>) {
+    return std::make_tuple(columns[I][j]...);
+}
+
 template<typename ... Ts, std::size_t ... Is>
 bool box_contains_helper(const std::tuple<Ts...> &min,
                          const std::tuple<Ts...> &max,
@@ -88,3 +93,16 @@ constexpr bool box_contains(const std::pair<T1, T2> &min, const std::pair<T1, T2
                         std::make_tuple(max.first, max.second),
                         std::make_tuple(p.first, p.second));
 }
+
+template<typename ... Ts, std::size_t ... Is>
+long double squared_distance_helper(const std::tuple<Ts...> &p,
+                                    const std::tuple<Ts...> &q,
+                                    const std::index_sequence<Is...> &) {
+    auto field = [](long double a, long double b) { return (a - b) * (a - b); };
+    return (field(std::get<Is>(p), std::get<Is>(q)) + ...);
+}
+
+template<typename ... Ts>
+long double squared_distance(const std::tuple<Ts...> &p, const std::tuple<Ts...> &q) {
+    return squared_distance_helper(p, q, std::make_index_sequence<sizeof...(Ts)>{});
+}
@@ -17,19 +17,42 @@
 #include "args.hxx"
 #include <cstdint>
 #include <iostream>
+#include <limits>
 
 template<typename K>
 void run_tuner(args::ValueFlag<size_t> &time,
                args::ValueFlag<size_t> &space,
                args::ValueFlag<double> &tol,
                args::ValueFlag<float> &ratio,
+               args::ValueFlag<std::string> &workload,
+               args::ValueFlag<std::string> &weights,
+               args::ValueFlag<std::string> &timestamps,
+               args::ValueFlag<size_t> &max_queries,
+               args::ValueFlag<std::string> &variants,
+               args::Flag &pareto,
+               args::ValueFlag<size_t> &jobs,
+               args::Flag &no_model,
                args::Positional<std::string> &file);
 
+/** The options of the tuning of DynamicPGMIndex. */
+struct DynamicTuningOptions {
+    std::string operations_file; ///< A trace of operations, overrides mix if not empty.
+    OperationMix mix;
+    std::vector<uint8_t> bases;
+    size_t max_bytes;
+    uint64_t max_insert_ns;
+    double insert_percentile;
+};
+
+template<typename K>
+void run_dynamic_tuner(const DynamicTuningOptions &options, const std::string &file);
+
 int main(int argc, char **argv) {
     using namespace args;
     ArgumentParser p("Space-time trade-off tuner for the PGM-index. \n\nThis program lets you specify a maximum space "
                      "and get the PGM-index minimising the query time within that space. Or, it lets you specify a "
-                     "maximum query time and get the PGM-index minimising the space.");
+                     "maximum query time and get the PGM-index minimising the space. The search spans the variants of "
+                     "the PGM-index and their parameters, and it ends with the template instantiation to use.");
     p.helpParams.flagindent = 2;
     p.helpParams.helpindent = 25;
     p.helpParams.progindent = 0;
@@ -37,12 +60,46 @@ int main(int argc, char **argv) {
 
     HelpFlag help(p, "help", "Display this help menu", {'h', "help"});
     ValueFlag<double> tol(p, "float", "Tolerance between 0 and 1 on the constraint (default 0.01)", {'o', "tol"}, 0.01);
-    ValueFlag<float> ratio(p, "ratio", "Ratio of lookups in the query workload (default 0.33)", {'r', "ratio"}, 0.333);
     Flag verbose(p, "verbose", "Show additional logging info", {'v', "verbose"});
+    ValueFlag<size_t> jobs(p, "n", "Number of indexes built concurrently (default: number of cores)", {'j', "jobs"},
+                           std::max(1u, std::thread::hardware_concurrency()));
+    Flag no_model(p, "", "Search every class, without the latency model that prunes the unpromising ones",
+                  {"no-model"});
+    ValueFlag<std::string> variants(p, "list", "Comma-separated classes among pgm, bucketing, ef, compressed (default "
+                                               "all)", {"variants"}, "pgm,bucketing,ef,compressed");
+
+    Group w(p, "QUERY WORKLOAD OPTIONS (mutually exclusive):", args::Group::Validators::AtMostOne);
+    ValueFlag<float> ratio(w, "ratio", "Random workload with the given lookup ratio (default 0.33)", {'r', "ratio"}, 0.333);
+    ValueFlag<std::string> workload(w, "file", "Trace of queries, replayed in order. Obeys the format of input files",
+                                    {'w', "workload"});
+
+    Group r(p, "TRACE OPTIONS:");
+    ValueFlag<std::string> weights(r, "file", "Weight of each query of the trace, as unsigned 64-bit ints",
+                                   {"weights"});
+    ValueFlag<std::string> timestamps(r, "file", "Time of each query of the trace, as unsigned 64-bit ints. The "
+                                                 "queries are replayed in order of time", {"timestamps"});
+    ValueFlag<size_t> max_queries(r, "n", "Maximum number of queries replayed from the trace (default 1000000)",
+                                  {"max-queries"}, 1000000);
 
     Group g(p, "OPERATION MODES:", args::Group::Validators::Xor, args::Options::Required);
     ValueFlag<size_t> time(g, "ns", "Specify a time to minimise the space", {'t', "time"});
     ValueFlag<size_t> space(g, "bytes", "Specify a space to minimise the time", {'s', "space"});
+    Flag pareto(g, "", "Output the indexes on the Pareto frontier of space and time", {"pareto"});
+    Flag dynamic(g, "", "Recommend the parameters of DynamicPGMIndex with the highest throughput on a workload of "
+                        "updates and queries", {"dynamic"});
+
+    Group d(p, "DYNAMIC TUNING OPTIONS:");
+    ValueFlag<std::string> ops(d, "file", "Trace of operations, one per line: i, u, e, f, s or r (insert, update, erase, "
+                                          "find, scan, read-modify-write), the key and the scan length", {"ops"});
+    ValueFlag<std::string> mix(d, "mix", "Synthetic workload: a YCSB workload among a-f, or insert:update:erase:find:scan "
+                                         "percentages (default 50:0:0:50:0)", {"mix"}, "50:0:0:50:0");
+    ValueFlag<std::string> bases(d, "list", "Comma-separated bases to try (default 4,8,16)", {"bases"}, "4,8,16");
+    ValueFlag<size_t> max_memory(d, "bytes", "Maximum peak space of the index", {"max-memory"},
+                                 std::numeric_limits<size_t>::max());
+    ValueFlag<uint64_t> max_insert_ns(d, "ns", "Maximum latency of insertions", {"max-insert-ns"},
+                                      std::numeric_limits<uint64_t>::max());
+    ValueFlag<double> insert_percentile(d, "p", "Percentile of the latency of insertions within --max-insert-ns "
+                                                "(default 99)", {"insert-percentile"}, 99);
 
     Group t(p, "INPUT DATA OPTIONS:", args::Group::Validators::Xor, args::Options::Required);
     Flag u64(t, "", "Input file contains unsigned 64-bit ints", {'U', "u64"});
@@ -70,14 +127,52 @@ int main(int argc, char **argv) {
 
     global_verbose = verbose.Get();
 
+    if ((weights || timestamps) && !workload) {
+        std::cerr << "The weights and the timestamps require a workload file." << std::endl;
+        return 1;
+    }
+
+    if (dynamic) {
+        DynamicTuningOptions options;
+        try {
+            options.operations_file = ops.Get();
+            options.mix = OperationMix::parse(mix.Get());
+            for (auto &b : split(bases.Get(), ',')) {
+                auto base = std::stoul(b);
+                if (base < 2 || base > 128 || (base & (base - 1)) != 0) {
+                    std::cerr << "Argument to --" << bases.GetMatcher().GetLongOrAny().str()
+                              << " must be a power of two between 2 and 128." << std::endl;
+                    return 1;
+                }
+                options.bases.push_back(uint8_t(base));
+            }
+        } catch (std::exception &e) {
+            std::cerr << "Invalid dynamic tuning options: " << e.what() << "." << std::endl;
+            return 1;
+        }
+        options.max_bytes = max_memory.Get();
+        options.max_insert_ns = max_insert_ns.Get();
+        options.insert_percentile = std::clamp(insert_percentile.Get(), 0., 100.);
+
+        if (i64.Get())
+            run_dynamic_tuner<int64_t>(options, file.Get());
+        if (u64.Get())
+            run_dynamic_tuner<uint64_t>(options, file.Get());
+        if (i32.Get())
+            run_dynamic_tuner<int32_t>(options, file.Get());
+        if (u32.Get())
+            run_dynamic_tuner<uint32_t>(options, file.Get());
+        return 0;
+    }
+
     if (i64.Get())
-        run_tuner<int64_t>(time, space, tol, ratio, file);
+        run_tuner<int64_t>(time, space, tol, ratio, workload, weights, timestamps, max_queries, variants, pareto, jobs, no_model, file);
     if (u64.Get())
-        run_tuner<uint64_t>(time, space, tol, ratio, file);
+        run_tuner<uint64_t>(time, space, tol, ratio, workload, weights, timestamps, max_queries, variants, pareto, jobs, no_model, file);
     if (i32.Get())
-        run_tuner<int32_t>(time, space, tol, ratio, file);
+        run_tuner<int32_t>(time, space, tol, ratio, workload, weights, timestamps, max_queries, variants, pareto, jobs, no_model, file);
     if (u32.Get())
-        run_tuner<uint32_t>(time, space, tol, ratio, file);
+        run_tuner<uint32_t>(time, space, tol, ratio, workload, weights, timestamps, max_queries, variants, pareto, jobs, no_model, file);
 }
 
 template<typename K>
@@ -85,6 +180,14 @@ void run_tuner(args::ValueFlag<size_t> &time,
                args::ValueFlag<size_t> &space,
                args::ValueFlag<double> &tol,
                args::ValueFlag<float> &ratio,
+               args::ValueFlag<std::string> &workload,
+               args::ValueFlag<std::string> &weights,
+               args::ValueFlag<std::string> &timestamps,
+               args::ValueFlag<size_t> &max_queries,
+               args::ValueFlag<std::string> &variants,
+               args::Flag &pareto,
+               args::ValueFlag<size_t> &jobs,
+               args::Flag &no_model,
                args::Positional<std::string> &file) {
     std::vector<K> data = read_data_binary<K>(file.Get(), true);
 
@@ -96,16 +199,79 @@ void run_tuner(args::ValueFlag<size_t> &time,
     std::printf("Dataset: %zu entries\n", data.size());
     if (minimize_space)
         std::printf("Max time: %zu±%.0f ns\n", time.Get(), time.Get() * tol.Get());
-    else
+    else if (space)
         std::printf("Max space: %zu±%.0f KiB\n", space.Get() / (1ul << 10ul), space.Get() * tol.Get() / (1ul << 10ul));
 
+    std::vector<K> queries;
+    std::vector<Candidate> candidates;
+    try {
+        if (workload) {
+            auto trace = read_data_binary<K>(workload.Get(), false);
+            auto trace_weights = weights ? read_data_binary<uint64_t>(weights.Get(), false) : std::vector<uint64_t>();
+            auto trace_timestamps = timestamps ? read_data_binary<uint64_t>(timestamps.Get(), false)
+                                               : std::vector<uint64_t>();
+            queries = replay_queries(trace, trace_weights, trace_timestamps, std::max<size_t>(max_queries.Get(), 1));
+            std::printf("Workload: %zu queries, replayed from a trace of %zu\n", queries.size(), trace.size());
+        } else
+            queries = generate_queries(data.begin(), data.end(), ratio.Get(), 1000000);
+        candidates = make_candidates(split(variants.Get(), ','), data, queries);
+    } catch (std::invalid_argument &e) {
+        std::cerr << e.what() << "." << std::endl;
+        std::exit(1);
+    }
+
     std::printf("%s\n", std::string(80, '-').c_str());
     std::printf("%-19s %-19s %-19s %-19s\n", "Epsilon", "Construction (s)", "Space (KiB)", "Query (ns)");
     std::printf("%s\n", std::string(80, '-').c_str());
 
-    auto queries = generate_queries(data.begin(), data.end(), ratio.Get(), 1000000);
-    if (minimize_space)
-        minimize_space_given_time(time.Get(), tol.Get(), data, queries, lo_eps, hi_eps, global_verbose);
-    else
-        minimize_time_given_space(space.Get(), tol.Get(), data, queries, lo_eps, hi_eps, global_verbose);
-}
\ No newline at end of file
+    if (pareto) {
+        tune_pareto<K>(candidates, lo_eps, hi_eps, std::max<size_t>(jobs.Get(), 1), global_verbose);
+        return;
+    }
+
+    auto max_time_or_space = minimize_space ? time.Get() : space.Get();
+    tune<K>(minimize_space, max_time_or_space, tol.Get(), candidates, data.size(), lo_eps, hi_eps,
+            std::max<size_t>(jobs.Get(), 1), !no_model, global_verbose);
+}
+template<typename K>
+void run_dynamic_tuner(const DynamicTuningOptions &options, const std::string &file) {
+    std::vector<K> keys = read_data_binary<K>(file, true);
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    // Like the dynamic benchmark, a synthetic workload inserts the half of the keys that are not bulk loaded
+    std::vector<DynamicOperation<K>> operations;
+    try {
+        if (!options.operations_file.empty()) {
+            operations = read_operations<K>(options.operations_file);
+        } else {
+            std::shuffle(keys.begin(), keys.end(), std::mt19937_64(42));
+            auto load_size = std::max<size_t>(1, keys.size() / 2);
+            std::vector<K> new_keys(keys.begin() + load_size, keys.end());
+            keys.resize(load_size);
+            std::sort(keys.begin(), keys.end());
+            auto count = std::min<size_t>(keys.size() + new_keys.size(), 1000000);
+            operations = generate_operations(keys, new_keys, options.mix, count, BenchmarkOptions(),
+                                             DynamicBenchmarkOptions());
+        }
+    } catch (std::invalid_argument &e) {
+        std::cerr << e.what() << "." << std::endl;
+        std::exit(1);
+    }
+
+    std::vector<std::pair<K, uint64_t>> loaded(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i)
+        loaded[i] = {keys[i], i};
+
+    std::printf("Dataset: %zu entries bulk loaded\n", loaded.size());
+    std::printf("Workload: %zu operations from %s\n", operations.size(),
+                options.operations_file.empty() ? ("the mix " + options.mix.name).c_str()
+                                                : options.operations_file.c_str());
+    if (options.max_bytes != std::numeric_limits<size_t>::max())
+        std::printf("Max space: %zu KiB\n", options.max_bytes / (1ul << 10ul));
+    if (options.max_insert_ns != std::numeric_limits<uint64_t>::max())
+        std::printf("Max insertion latency: %llu ns\n", (unsigned long long) options.max_insert_ns);
+    std::printf("%s\n", std::string(80, '-').c_str());
+
+    tune_dynamic(loaded, operations, options.bases, options.max_bytes, options.max_insert_ns,
+                 options.insert_percentile);
+}
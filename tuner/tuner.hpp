@@ -16,6 +16,8 @@
 #pragma once
 
 #include "benchmark.hpp"
+#include "benchmark_dynamic.hpp"
+#include "mock_pgm_index.hpp"
 #include "pgm/pgm_index.hpp"
 #include <algorithm>
 #include <chrono>
@@ -23,45 +25,26 @@
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <fstream>
+#include <functional>
 #include <iterator>
 #include <memory>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <tuple>
 #include <utility>
 #include <vector>
 
-#define PGM_IGNORED_PARAMETER 1
-#define PGM_EPSILON_RECURSIVE 4
-
-template<typename K>
-class MockPGMIndex : public pgm::PGMIndex<K, PGM_IGNORED_PARAMETER, PGM_EPSILON_RECURSIVE, double> {
-    size_t epsilon;
-
-public:
-
-    using segment_type = typename pgm::PGMIndex<K, PGM_IGNORED_PARAMETER, PGM_EPSILON_RECURSIVE, double>::Segment;
-
-    MockPGMIndex() = default;
-
-    MockPGMIndex(const std::vector<K> &data, size_t epsilon) : epsilon(epsilon) {
-        this->n = data.size();
-        this->first_key = data[0];
-        this->build(data.begin(), data.end(), epsilon, PGM_EPSILON_RECURSIVE, this->segments, this->levels_offsets);
-    }
-
-    pgm::ApproxPos search(const K &key) const {
-        auto k = std::max(this->first_key, key);
-        auto it = this->segment_for_key(k);
-        auto pos = std::min<size_t>((*it)(k), std::next(it)->intercept);
-        auto lo = PGM_SUB_EPS(pos, epsilon);
-        auto hi = PGM_ADD_EPS(pos, epsilon, this->n);
-        return {pos, lo, hi};
-    }
-};
-
 /*------- INDEX STATS -------*/
 
 struct IndexStats {
+    static constexpr int repetitions = 5; ///< The queries are timed repetitions - 1 times.
+
     size_t epsilon;
     size_t segments_count;
     size_t bytes;
@@ -71,16 +54,13 @@ struct IndexStats {
 
     IndexStats() = default;
 
-    template<typename K>
-    IndexStats(const std::vector<K> &data, const std::vector<K> &queries, size_t epsilon) : epsilon(epsilon) {
-        auto start = timer::now();
-        MockPGMIndex<K> pgm(data, epsilon);
-        auto end = timer::now();
-        construction_ns = size_t(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
-
+    /** Times the queries on the given index, which was built with the given ε in construction_ns nanoseconds. */
+    template<typename Index, typename K>
+    IndexStats(const Index &pgm, size_t epsilon, size_t construction_ns, const std::vector<K> &data,
+               const std::vector<K> &queries)
+        : epsilon(epsilon), construction_ns(construction_ns) {
         double avg_time = 0;
         double var_time = 0;
-        const int repetitions = 5;
 
         for (int repetition = 1; repetition < repetitions; ++repetition) {
             auto t0 = timer::now();
@@ -104,10 +84,236 @@ struct IndexStats {
         segments_count = pgm.segments_count();
         bytes = pgm.size_in_bytes();
         lookup_ns = size_t(avg_time);
-        lookup_ns_std = size_t(std::sqrt(var_time / (repetitions - 1)));
+        lookup_ns_std = size_t(std::sqrt(var_time / (repetitions - 2))); // Sample deviation of repetitions - 1 runs
     }
+
+    /** Returns the half-width of the 95% confidence interval of lookup_ns. */
+    double lookup_ns_ci() const {
+        static_assert(repetitions == 5, "The quantile below is for repetitions - 2 degrees of freedom");
+        const auto t_quantile = 3.182;
+        return t_quantile * lookup_ns_std / std::sqrt(repetitions - 1.);
+    }
+};
+
+/*------- QUERY WORKLOAD -------*/
+
+/**
+ * Turns a trace of queries into the sequence of at most max_queries queries on which the indexes are timed.
+ *
+ * The queries are replayed in the order of their timestamps, if any, or else in the order of the trace, so that the
+ * timings reflect the locality between consecutive queries. Without weights, the sequence is the longest prefix of the
+ * trace within max_queries. With weights, each query of the trace occurs in the sequence a number of times
+ * proportional to its weight, which is obtained by a systematic sampling of the whole trace.
+ * @param trace the keys of the queries
+ * @param weights the weight of each query, or empty for unit weights
+ * @param timestamps the time of each query, or empty if the trace is in order of time
+ * @param max_queries the maximum length of the sequence
+ * @return the sequence of queries
+ */
+template<typename K>
+std::vector<K> replay_queries(const std::vector<K> &trace, const std::vector<uint64_t> &weights,
+                              const std::vector<uint64_t> &timestamps, size_t max_queries) {
+    if (trace.empty())
+        throw std::invalid_argument("The workload file contains no queries");
+    if (!weights.empty() && weights.size() != trace.size())
+        throw std::invalid_argument("The weights file has " + std::to_string(weights.size()) + " entries, but the "
+                                    "workload file has " + std::to_string(trace.size()) + " queries");
+    if (!timestamps.empty() && timestamps.size() != trace.size())
+        throw std::invalid_argument("The timestamps file has " + std::to_string(timestamps.size()) + " entries, but the "
+                                    "workload file has " + std::to_string(trace.size()) + " queries");
+
+    std::vector<size_t> order(trace.size());
+    std::iota(order.begin(), order.end(), 0);
+    if (!timestamps.empty())
+        std::stable_sort(order.begin(), order.end(), [&](auto i, auto j) { return timestamps[i] < timestamps[j]; });
+
+    std::vector<K> queries;
+    if (weights.empty()) {
+        queries.reserve(std::min(trace.size(), max_queries));
+        for (size_t i = 0; i < order.size() && i < max_queries; ++i)
+            queries.push_back(trace[order[i]]);
+        return queries;
+    }
+
+    auto total_weight = std::accumulate(weights.begin(), weights.end(), 0.L);
+    if (total_weight == 0)
+        throw std::invalid_argument("The weights of the queries sum to zero");
+
+    // Query i is repeated as many times as the multiples of step in its interval of cumulative weight
+    auto step = std::max(total_weight / max_queries, 1.L);
+    long double cumulative = 0;
+    for (auto i : order) {
+        auto before = size_t(cumulative / step);
+        cumulative += weights[i];
+        for (auto count = size_t(cumulative / step) - before; count > 0 && queries.size() < max_queries; --count)
+            queries.push_back(trace[i]);
+    }
+    return queries;
+}
+
+/*------- CANDIDATE INDEXES -------*/
+
+template<typename K>
+std::string key_type_name() {
+    if constexpr (std::is_same_v<K, int64_t>) return "int64_t";
+    else if constexpr (std::is_same_v<K, uint64_t>) return "uint64_t";
+    else if constexpr (std::is_same_v<K, int32_t>) return "int32_t";
+    else if constexpr (std::is_same_v<K, uint32_t>) return "uint32_t";
+    else return demangle(typeid(K).name());
+}
+
+/** A class of the library, with all its template arguments but Epsilon fixed, among which the tuner looks for the best. */
+struct Candidate {
+    /** How a lookup finds the segment of a key, which determines the memory accesses in the latency model. */
+    enum class Structure { Recursive, Bucketing, EliasFano };
+
+    std::string prefix;  ///< The name of the class up to the value of Epsilon.
+    std::string suffix;  ///< The name of the class after the value of Epsilon.
+    std::function<std::function<IndexStats()>(size_t)> build; ///< Builds the class with the given ε, returns its timer.
+    Structure structure; ///< How a lookup finds the segment of a key.
+    size_t parameter;    ///< The EpsilonRecursive of a Recursive structure, or the TopLevelSize of a Bucketing one.
+
+    /** Returns the template instantiation of the class with the given value of Epsilon. */
+    std::string name(const std::string &epsilon) const { return prefix + epsilon + suffix; }
+
+    /** Builds the class with the given ε and returns its statistics. */
+    IndexStats measure(size_t epsilon) const { return build(epsilon)(); }
 };
 
+/**
+ * Returns the candidates of the given variants, among pgm, bucketing, ef and compressed, which also span the values of
+ * EpsilonRecursive and TopLevelSize worth trying.
+ */
+template<typename K>
+std::vector<Candidate> make_candidates(const std::vector<std::string> &variants, const std::vector<K> &data,
+                                       const std::vector<K> &queries) {
+    std::vector<Candidate> candidates;
+    auto key = key_type_name<K>();
+    using structure = Candidate::Structure;
+    auto add = [&](auto t, const std::string &prefix, const std::string &suffix, structure st, size_t parameter) {
+        using index_type = typename decltype(t)::type;
+        auto build = [&data, &queries](size_t epsilon) -> std::function<IndexStats()> {
+            auto start = timer::now();
+            auto index = std::make_shared<index_type>(data.begin(), data.end(), epsilon);
+            auto end = timer::now();
+            auto construction_ns = size_t(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+            return [&data, &queries, index, epsilon, construction_ns] {
+                return IndexStats(*index, epsilon, construction_ns, data, queries);
+            };
+        };
+        candidates.push_back({prefix, suffix, build, st, parameter});
+    };
+
+    for (auto &variant : variants) {
+        if (variant == "pgm") {
+            auto p = "pgm::PGMIndex<" + key + ", ";
+            add(type_wrapper<MockPGMIndex<K, 2>>{}, p, ", 2>", structure::Recursive, 2);
+            add(type_wrapper<MockPGMIndex<K, 4>>{}, p, ", 4>", structure::Recursive, 4);
+            add(type_wrapper<MockPGMIndex<K, 8>>{}, p, ", 8>", structure::Recursive, 8);
+            add(type_wrapper<MockPGMIndex<K, 16>>{}, p, ", 16>", structure::Recursive, 16);
+        } else if (variant == "bucketing") {
+            auto p = "pgm::BucketingPGMIndex<" + key + ", ";
+            add(type_wrapper<MockBucketingPGMIndex<K, 1 << 16>>{}, p, ", 65536>", structure::Bucketing, 1 << 16);
+            add(type_wrapper<MockBucketingPGMIndex<K, 1 << 20>>{}, p, ", 1048576>", structure::Bucketing, 1 << 20);
+            add(type_wrapper<MockBucketingPGMIndex<K, 1 << 24>>{}, p, ", 16777216>", structure::Bucketing, 1 << 24);
+        } else if (variant == "ef") {
+            add(type_wrapper<MockEliasFanoPGMIndex<K>>{}, "pgm::EliasFanoPGMIndex<" + key + ", ", ">",
+                structure::EliasFano, 0);
+        } else if (variant == "compressed") {
+            auto p = "pgm::CompressedPGMIndex<" + key + ", ";
+            add(type_wrapper<MockCompressedPGMIndex<K, 2>>{}, p, ", 2>", structure::Recursive, 2);
+            add(type_wrapper<MockCompressedPGMIndex<K, 4>>{}, p, ", 4>", structure::Recursive, 4);
+            add(type_wrapper<MockCompressedPGMIndex<K, 8>>{}, p, ", 8>", structure::Recursive, 8);
+            add(type_wrapper<MockCompressedPGMIndex<K, 16>>{}, p, ", 16>", structure::Recursive, 16);
+        } else
+            throw std::invalid_argument("Unknown variant " + variant);
+    }
+    return candidates;
+}
+
+/*------- PARALLEL EVALUATION -------*/
+
+/**
+ * Returns the statistics of the given candidates with the given values of ε. The indexes are processed in chunks of
+ * @p jobs: the indexes of a chunk are built concurrently, each with a single thread, then their queries are timed one
+ * index at a time and with no build running, so that the timings do not interfere with each other. The indexes of a
+ * chunk are released before the next chunk is built, so at most @p jobs of them are in memory at once.
+ */
+inline std::vector<IndexStats> measure_all(const std::vector<std::pair<const Candidate *, size_t>> &indexes,
+                                           size_t jobs) {
+    std::vector<IndexStats> stats;
+    stats.reserve(indexes.size());
+    auto workers = std::max<size_t>(jobs, 1);
+
+    for (size_t chunk = 0; chunk < indexes.size(); chunk += workers) {
+        auto chunk_size = std::min(workers, indexes.size() - chunk);
+        std::vector<std::function<IndexStats()>> timers(chunk_size);
+        auto build = [&](size_t i) { timers[i] = indexes[chunk + i].first->build(indexes[chunk + i].second); };
+
+        if (chunk_size == 1) {
+            build(0);
+        } else {
+            std::vector<std::thread> threads;
+            for (size_t i = 0; i < chunk_size; ++i) {
+                threads.emplace_back([&, i] {
+#ifdef _OPENMP
+                    omp_set_num_threads(1);
+#endif
+                    build(i);
+                });
+            }
+            for (auto &t : threads)
+                t.join();
+        }
+
+        for (auto &t : timers) {
+            stats.push_back(t());
+            t = nullptr;
+        }
+    }
+    return stats;
+}
+
+inline std::vector<IndexStats> measure_all(const Candidate &candidate, const std::vector<size_t> &epsilons,
+                                           size_t jobs) {
+    std::vector<std::pair<const Candidate *, size_t>> indexes;
+    for (auto eps : epsilons)
+        indexes.emplace_back(&candidate, eps);
+    return measure_all(indexes, jobs);
+}
+
+/**
+ * Returns, in increasing order, @p mid and up to count - 1 values of ε evenly spaced in (lo, mid) and (mid, hi), that
+ * are the next values a bisection of [lo, hi] would try after mid.
+ */
+inline std::vector<size_t> speculative_bracket(size_t lo, size_t mid, size_t hi, size_t count) {
+    std::vector<size_t> out = {mid};
+    auto left = count / 2;
+    auto right = count > 0 ? (count - 1) / 2 : 0;
+    for (size_t k = 1; k <= left; ++k)
+        out.push_back(lo + (mid - lo) * k / (left + 1));
+    for (size_t k = 1; k <= right; ++k)
+        out.push_back(mid + (hi - mid) * k / (right + 1));
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    return out;
+}
+
+/**
+ * Narrows the search range [lo, hi] given some statistics in increasing order of ε, assuming that @p pred holds for all
+ * values of ε from some point on.
+ */
+template<typename Pred>
+void narrow_search_range(size_t &lo, size_t &hi, const std::vector<IndexStats> &stats, Pred pred) {
+    for (auto &s : stats) {
+        if (pred(s)) {
+            hi = std::min(hi, s.epsilon);
+            break;
+        }
+        lo = std::max(lo, s.epsilon + 1);
+    }
+}
+
 /*------- FUNCTION FITTING -------*/
 
 /** Fits the coefficients (a,b) of a function f(ε)=aε^b. */
@@ -169,10 +375,159 @@ double guess_epsilon_space(double x, double a, double b, double max_space, doubl
     return std::fmax(0., x);
 }
 
-/*------- CORE FUNCTIONS -------*/
+/*------- LATENCY MODEL -------*/
 
 size_t cache_line_size();
 
+/** The sizes in bytes of the L1 data, L2 and last-level caches. */
+struct CacheSizes {
+    size_t l1;
+    size_t l2;
+    size_t llc;
+};
+
+CacheSizes cache_sizes();
+
+/** Returns the mean latency in nanoseconds of a chain of dependent loads from random cache lines of a buffer. */
+inline double pointer_chase_ns(size_t bytes) {
+    auto line = std::max<size_t>(cache_line_size(), 64) / sizeof(size_t);
+    auto lines = std::max<size_t>(bytes / (line * sizeof(size_t)), 2);
+    std::vector<size_t> order(lines);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin() + 1, order.end(), std::mt19937_64(42));
+
+    // Each line stores the position of the next line of a single cycle through all of them
+    std::vector<size_t> buffer(lines * line);
+    for (size_t i = 0; i < lines; ++i)
+        buffer[order[i] * line] = order[(i + 1) % lines] * line;
+
+    const size_t steps = 1 << 21;
+    size_t pos = 0;
+    for (size_t i = 0; i < std::min(lines, steps); ++i)
+        pos = buffer[pos];
+    auto t0 = timer::now();
+    for (size_t i = 0; i < steps; ++i)
+        pos = buffer[pos];
+    auto t1 = timer::now();
+    [[maybe_unused]] volatile auto tmp = pos;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / double(steps);
+}
+
+/** The latency of a random access to data that fits in each level of the memory hierarchy. */
+struct MemoryLatency {
+    CacheSizes caches;
+    double l1_ns;
+    double l2_ns;
+    double llc_ns;
+    double dram_ns;
+
+    /** Measures the latencies with buffers half the size of each cache, and larger than the last-level cache. */
+    static MemoryLatency measure() {
+        auto caches = cache_sizes();
+        auto dram_bytes = std::clamp<size_t>(4 * caches.llc, 64ull << 20, 512ull << 20);
+        return {caches, pointer_chase_ns(caches.l1 / 2), pointer_chase_ns(caches.l2 / 2),
+                pointer_chase_ns(caches.llc / 2), pointer_chase_ns(dram_bytes)};
+    }
+
+    /**
+     * Returns the expected latency of a random access to a structure of the given size, assuming that each cache holds
+     * as much of the structure as it can.
+     */
+    double access_ns(double bytes) const {
+        auto fits = [&](size_t capacity) { return std::min(1., capacity / std::max(bytes, 1.)); };
+        auto p1 = fits(caches.l1);
+        auto p2 = std::max(p1, fits(caches.l2));
+        auto p3 = std::max(p2, fits(caches.llc));
+        return l1_ns * p1 + l2_ns * (p2 - p1) + llc_ns * (p3 - p2) + dram_ns * (1 - p3);
+    }
+};
+
+/**
+ * Predicts the space and the query time of the indexes of a candidate from ε, without building them.
+ *
+ * The number of segments m is a power law aε^b of ε, fitted on the indexes built so far, and the space is c0 + c1 m.
+ * The query time is α + β M, where M is the memory cost of a lookup: for each structure that the lookup visits (the
+ * levels of the recursive index, the top-level table, the Elias-Fano sequence, and the window of 2ε+2 keys of the
+ * data) the cache lines it reads times the latency of a random access to a structure of that size. The constants c0,
+ * c1, α and β of a candidate are calibrated on two of its indexes.
+ */
+struct LatencyModel {
+    const Candidate *candidate;
+    size_t n;          ///< The number of keys.
+    size_t key_bytes;  ///< The size of a key.
+    double a, b;       ///< The coefficients of the segments count model m(ε) = aε^b.
+    double c0 = 0, c1 = 0;
+    double alpha = 0, beta = 1;
+
+    /** Returns the memory cost of a lookup in the index with the given ε, m segments and the given size. */
+    double memory_cost(const MemoryLatency &latency, double epsilon, double m, double bytes) const {
+        m = std::max(m, 1.);
+        auto line = double(std::max<size_t>(cache_line_size(), 64));
+        auto binary_search_lines = [&](double window_bytes) { return std::log2(std::max(window_bytes / line, 1.)) + 1; };
+
+        double cost = 0;
+        switch (candidate->structure) {
+            case Candidate::Structure::Recursive: {
+                // The levels shrink by a factor of at least 2 EpsilonRecursive up to the root, which is not searched
+                auto eps_rec = double(candidate->parameter);
+                std::vector<double> levels = {m};
+                while (levels.back() > 1)
+                    levels.push_back(std::ceil(levels.back() / (2 * eps_rec)));
+                auto total = std::accumulate(levels.begin(), levels.end(), 0.);
+                auto segment_bytes = std::max(bytes - c0, 1.) / total;
+                for (size_t l = 0; l + 1 < levels.size(); ++l)
+                    cost += (1 + (eps_rec + 1) * segment_bytes / line) * latency.access_ns(levels[l] * segment_bytes);
+                break;
+            }
+            case Candidate::Structure::Bucketing: {
+                auto segment_bytes = std::max(bytes - c0, 1.) / m;
+                cost += latency.access_ns(std::max(c0, line));
+                auto bucket = m / candidate->parameter + 1;
+                cost += binary_search_lines(bucket * segment_bytes) * latency.access_ns(m * segment_bytes);
+                break;
+            }
+            case Candidate::Structure::EliasFano:
+                // A predecessor search in the Elias-Fano sequence, then the segment
+                cost += 4 * latency.access_ns(bytes);
+                break;
+        }
+
+        auto data_bytes = double(n) * key_bytes;
+        cost += binary_search_lines((2 * epsilon + 2) * key_bytes) * latency.access_ns(data_bytes);
+        return cost;
+    }
+
+    double segments(double epsilon) const { return a * std::pow(epsilon, b); }
+
+    double bytes(double epsilon) const { return c0 + c1 * segments(epsilon); }
+
+    double lookup_ns(const MemoryLatency &latency, double epsilon) const {
+        return alpha + beta * memory_cost(latency, epsilon, segments(epsilon), bytes(epsilon));
+    }
+
+    /** Calibrates c0, c1, α and β on two indexes of the candidate with different ε. */
+    void calibrate(const MemoryLatency &latency, const IndexStats &x, const IndexStats &y) {
+        auto mx = double(std::max<size_t>(x.segments_count, 1));
+        auto my = double(std::max<size_t>(y.segments_count, 1));
+        c1 = mx != my ? (double(x.bytes) - double(y.bytes)) / (mx - my) : 0;
+        if (c1 <= 0)
+            c1 = (x.bytes + y.bytes) / (mx + my);
+        c0 = std::max(0., x.bytes - c1 * mx);
+
+        auto cost_x = memory_cost(latency, x.epsilon, mx, x.bytes);
+        auto cost_y = memory_cost(latency, y.epsilon, my, y.bytes);
+        beta = cost_x != cost_y ? (double(x.lookup_ns) - double(y.lookup_ns)) / (cost_x - cost_y) : 0;
+        alpha = (x.lookup_ns + y.lookup_ns - beta * (cost_x + cost_y)) / 2;
+        if (beta <= 0 || alpha < 0) {
+            // The measurements are too noisy to fit both constants, so the query time is taken proportional to M
+            alpha = 0;
+            beta = (x.lookup_ns + y.lookup_ns) / std::max(cost_x + cost_y, 1.);
+        }
+    }
+};
+
+/*------- CORE FUNCTIONS -------*/
+
 void minimize_time_logging(const IndexStats &stats, bool verbose, size_t lo_eps, size_t hi_eps) {
     auto kib = stats.bytes / double(1u << 10u);
     auto query_time = std::to_string(stats.lookup_ns) + "±" + std::to_string(stats.lookup_ns_std);
@@ -184,13 +539,21 @@ void minimize_time_logging(const IndexStats &stats, bool verbose, size_t lo_eps,
     std::printf("\n");
 }
 
+/**
+ * Searches the ε of the given candidate that minimises the space of the index while keeping the query time within
+ * max_time.
+ * @param eps_guess if not zero, the first ε to try
+ * @return the statistics of the best index found, or nothing if no index satisfies the constraint
+ */
 template<typename K>
-void minimize_space_given_time(size_t max_time, double tolerance, const std::vector<K> &data,
-                               const std::vector<K> &queries, size_t lo_eps, size_t hi_eps, bool verbose) {
+std::optional<IndexStats> minimize_space_given_time(size_t max_time, double tolerance, const Candidate &candidate,
+                                                    size_t lo_eps, size_t hi_eps, size_t jobs, bool verbose,
+                                                    size_t eps_guess = 0) {
     auto latency = 82.1;
     auto cache_line = cache_line_size();
     auto block_size = cache_line / sizeof(K);
-    auto eps_start = std::clamp(size_t(block_size * std::pow(2., max_time / latency - 1.)), lo_eps, hi_eps);
+    auto eps_start = eps_guess ? eps_guess : size_t(block_size * std::pow(2., max_time / latency - 1.));
+    eps_start = std::clamp(eps_start, lo_eps, hi_eps);
 
     const size_t starting_i = 2048;
     auto i = starting_i;
@@ -198,61 +561,86 @@ void minimize_space_given_time(size_t max_time, double tolerance, const std::vec
     auto hi = hi_eps;
 
     std::vector<IndexStats> all_stats;
-    all_stats.emplace_back(data, queries, eps_start);
+    all_stats.push_back(candidate.measure(eps_start));
     minimize_time_logging(all_stats.back(), verbose, eps_start, eps_start);
 
+    // Gallop away from eps_start, measuring the next jobs steps at once. The steps past the one that ends the
+    // galloping are kept as they may still be the best
     if (all_stats.back().lookup_ns < max_time) {
-        while (eps_start + (i << 1) < hi_eps && all_stats.back().lookup_ns < max_time * (1 + tolerance)) {
-            i <<= 1;
-            all_stats.emplace_back(data, queries, eps_start + i);
-            lo = eps_start + i / 2;
-            hi = eps_start + i;
-            minimize_time_logging(all_stats.back(), verbose, lo, hi);
+        auto fast = true;
+        while (fast && eps_start + (i << 1) < hi_eps) {
+            std::vector<size_t> epsilons;
+            for (auto j = i << 1; epsilons.size() < std::max<size_t>(jobs, 1) && eps_start + j < hi_eps; j <<= 1)
+                epsilons.push_back(eps_start + j);
+            for (auto &stats : measure_all(candidate, epsilons, jobs)) {
+                all_stats.push_back(stats);
+                if (fast) {
+                    i <<= 1;
+                    lo = eps_start + i / 2;
+                    hi = eps_start + i;
+                    fast = stats.lookup_ns < max_time * (1 + tolerance);
+                }
+                minimize_time_logging(stats, verbose, lo, hi);
+            }
         }
         lo = i <= (starting_i << 1) ? eps_start : eps_start + i / 2;
     } else {
-        while (eps_start > (i << 1) + lo_eps && all_stats.back().lookup_ns > max_time * (1 - tolerance)) {
-            i <<= 1;
-            all_stats.emplace_back(data, queries, eps_start - i);
-            lo = eps_start - i;
-            hi = eps_start - i / 2;
-            minimize_time_logging(all_stats.back(), verbose, lo, hi);
+        auto slow = true;
+        while (slow && eps_start > (i << 1) + lo_eps) {
+            std::vector<size_t> epsilons;
+            for (auto j = i << 1; epsilons.size() < std::max<size_t>(jobs, 1) && eps_start > j + lo_eps; j <<= 1)
+                epsilons.push_back(eps_start - j);
+            for (auto &stats : measure_all(candidate, epsilons, jobs)) {
+                all_stats.push_back(stats);
+                if (slow) {
+                    i <<= 1;
+                    lo = eps_start - i;
+                    hi = eps_start - i / 2;
+                    slow = stats.lookup_ns > max_time * (1 - tolerance);
+                }
+                minimize_time_logging(stats, verbose, lo, hi);
+            }
         }
         hi = i <= (starting_i << 1) ? eps_start : eps_start - i / 2;
     }
 
+    // Bisect, measuring also the points that the next steps would try on both sides of the midpoint
     while (hi - lo > cache_line / 2) {
-        i = (hi + lo) / 2;
-        all_stats.emplace_back(data, queries, i);
-        if (all_stats.back().lookup_ns > max_time)
-            hi = i;
-        else
-            lo = i + 1;
-        minimize_time_logging(all_stats.back(), verbose, lo, hi);
+        auto epsilons = speculative_bracket(lo, (hi + lo) / 2, hi, jobs);
+        auto stats = measure_all(candidate, epsilons, jobs);
+        narrow_search_range(lo, hi, stats, [&](const IndexStats &s) { return s.lookup_ns > max_time; });
+        for (auto &s : stats) {
+            all_stats.push_back(s);
+            minimize_time_logging(s, verbose, lo, hi);
+        }
     }
 
     auto pred = [&](const IndexStats &a) { return a.lookup_ns <= max_time * (1 + tolerance); };
-    if (!std::any_of(all_stats.cbegin(), all_stats.cend(), pred)) {
-        std::printf("It is not possible to satisfy the given constraint. Increase the maximum time.");
-        std::exit(1);
-    }
-
     auto cmp = [&](const IndexStats &a, const IndexStats &b) { return !pred(b) || (pred(a) && a.bytes < b.bytes); };
     auto best = std::min_element(all_stats.cbegin(), all_stats.cend(), cmp);
-    std::printf("%s\n", std::string(80, '-').c_str());
-    std::printf("Set epsilon to %zu for an index of %zu bytes\n", best->epsilon, best->bytes);
+    if (!pred(*best))
+        return std::nullopt;
+    return *best;
 }
 
+/**
+ * Searches the ε of the given candidate that minimises the query time of the index while keeping its space within
+ * max_space.
+ * @param eps_guess if not zero, the first ε to try
+ * @return the statistics of the best index found, or nothing if no index satisfies the constraint
+ */
 template<typename K>
-void minimize_time_given_space(size_t max_space, double tolerance, const std::vector<K> &data,
-                               const std::vector<K> &queries, size_t lo_eps, size_t hi_eps, bool verbose) {
+std::optional<IndexStats> minimize_time_given_space(size_t max_space, double tolerance, const Candidate &candidate,
+                                                    size_t data_size, size_t lo_eps, size_t hi_eps, size_t jobs,
+                                                    bool verbose, size_t eps_guess = 0) {
     const auto guess_steps_threshold = size_t(2 * std::log2(std::log2(hi_eps - lo_eps)));
     size_t guess_steps = 0;
     std::vector<IndexStats> all_stats;
-    auto a = double(data.size() / 2);
+    auto a = double(data_size / 2);
     auto b = -1.;
     auto lo = lo_eps;
     auto hi = hi_eps;
+    auto close_enough = false;
 
     do {
         size_t guess = 0;
@@ -262,9 +650,14 @@ void minimize_time_given_space(size_t max_space, double tolerance, const std::ve
             std::tie(a,b) = fit_segments_count_model(all_stats);
 
         if (guess_steps < guess_steps_threshold) {
+            // The bytes per segment, as measured on the last index if any
             auto constants = sizeof(typename MockPGMIndex<K>::segment_type);
+            if (!all_stats.empty() && all_stats.back().segments_count > 0)
+                constants = all_stats.back().bytes / all_stats.back().segments_count;
 
             guess = size_t(guess_epsilon_space(100, a, -b, max_space, constants));
+            if (eps_guess && all_stats.empty())
+                guess = eps_guess;
             guess = std::clamp(guess, lo + 1, hi - 1);
 
             auto bias_weight = guess_steps <= 1 ? 0 : double(guess_steps) / guess_steps_threshold;
@@ -274,29 +667,501 @@ void minimize_time_given_space(size_t max_space, double tolerance, const std::ve
             guess_steps++;
         }
 
-        all_stats.emplace_back(data, queries, mid);
-        auto &stats = all_stats.back();
-        auto kib = stats.bytes / double(1u << 10u);
-        auto query_time = std::to_string(stats.lookup_ns) + "±" + std::to_string(stats.lookup_ns_std);
-        std::printf("%-19zu %-19.2f %-19.2f %-19s", mid, stats.construction_ns * 1.e-9, kib, query_time.c_str());
-        if (verbose) {
-            auto s = "(" + std::to_string(lo) + ", " + std::to_string(hi) + ")";
-            std::printf("\t↝ search space=%-15s \ts(ε)=%.0fε^%.2f \tε guess=%zu", s.c_str(), a, b, guess);
+        // Measure also the points that the next steps would try on both sides of mid
+        auto search_space = "(" + std::to_string(lo) + ", " + std::to_string(hi) + ")";
+        auto batch = measure_all(candidate, speculative_bracket(lo, mid, hi, jobs), jobs);
+        narrow_search_range(lo, hi, batch, [&](const IndexStats &s) { return s.bytes <= max_space; });
+        for (auto &stats : batch) {
+            all_stats.push_back(stats);
+            auto kib = stats.bytes / double(1u << 10u);
+            auto query_time = std::to_string(stats.lookup_ns) + "±" + std::to_string(stats.lookup_ns_std);
+            std::printf("%-19zu %-19.2f %-19.2f %-19s", stats.epsilon, stats.construction_ns * 1.e-9, kib,
+                        query_time.c_str());
+            if (verbose) {
+                std::printf("\t↝ search space=%-15s \ts(ε)=%.0fε^%.2f \tε guess=%zu", search_space.c_str(), a, b,
+                            guess);
+            }
+            std::printf("\n");
+            close_enough |= std::abs(stats.bytes - (double) max_space) <= max_space * tolerance;
+        }
+        std::fflush(stdout);
+    } while (lo < hi && !close_enough);
+
+    auto pred = [&](const IndexStats &s) { return s.bytes <= max_space * (1 + tolerance); };
+    auto cmp = [&](const IndexStats &x, const IndexStats &y) {
+        return !pred(y) || (pred(x) && x.lookup_ns < y.lookup_ns);
+    };
+    auto best = std::min_element(all_stats.cbegin(), all_stats.cend(), cmp);
+    if (!pred(*best))
+        return std::nullopt;
+    return *best;
+}
+
+/**
+ * Calibrates the latency model of each candidate on two of its indexes, and predicts the ε that is optimal under the
+ * constraint. The candidates whose predicted optimum is worse than the best predicted one by more than a margin are
+ * pruned.
+ * @return for each candidate, the predicted ε, 0 if the model predicts nothing useful, or nothing if it was pruned
+ */
+template<typename K>
+std::vector<std::optional<size_t>> predict_with_model(bool minimize_space, size_t max_time_or_space,
+                                                      const std::vector<Candidate> &candidates, size_t data_size,
+                                                      size_t lo_eps, size_t hi_eps, size_t jobs) {
+    const auto prune_margin = 0.25;
+    std::vector<std::optional<size_t>> guesses(candidates.size(), 0);
+    auto eps_x = std::clamp<size_t>(2 * lo_eps, lo_eps, hi_eps);
+    auto eps_y = std::clamp<size_t>(64 * lo_eps, lo_eps, hi_eps);
+    if (eps_x == eps_y)
+        return guesses;
+
+    auto latency = MemoryLatency::measure();
+    std::printf("Memory latency (ns): %.1f L1 (%zu KiB), %.1f L2 (%zu KiB), %.1f LLC (%zu KiB), %.1f DRAM\n",
+                latency.l1_ns, latency.caches.l1 >> 10, latency.l2_ns, latency.caches.l2 >> 10, latency.llc_ns,
+                latency.caches.llc >> 10, latency.dram_ns);
+
+    std::vector<std::pair<const Candidate *, size_t>> indexes;
+    for (auto &candidate : candidates) {
+        indexes.emplace_back(&candidate, eps_x);
+        indexes.emplace_back(&candidate, eps_y);
+    }
+    auto stats = measure_all(indexes, jobs);
+    for (size_t c = 0; c < candidates.size(); ++c) {
+        std::printf("%s (calibration)\n", candidates[c].name("ε").c_str());
+        minimize_time_logging(stats[2 * c], false, 0, 0);
+        minimize_time_logging(stats[2 * c + 1], false, 0, 0);
+    }
+
+    // The segments count depends little on the candidate, as all of them segment the keys with the same ε
+    auto[a, b] = fit_segments_count_model(stats);
+
+    std::vector<std::optional<std::tuple<size_t, double, double>>> predictions(candidates.size());
+    std::optional<double> best_objective;
+    for (size_t c = 0; c < candidates.size(); ++c) {
+        LatencyModel model{&candidates[c], data_size, sizeof(K), a, b};
+        model.calibrate(latency, stats[2 * c], stats[2 * c + 1]);
+        for (auto eps = double(lo_eps); eps <= hi_eps; eps *= 1.05) {
+            auto bytes = model.bytes(eps);
+            auto ns = model.lookup_ns(latency, eps);
+            auto feasible = minimize_space ? ns <= max_time_or_space : bytes <= max_time_or_space;
+            auto objective = minimize_space ? bytes : ns;
+            if (feasible && (!predictions[c] || objective < (minimize_space ? std::get<1>(*predictions[c])
+                                                                            : std::get<2>(*predictions[c]))))
+                predictions[c] = std::make_tuple(size_t(eps), bytes, ns);
+        }
+        if (predictions[c]) {
+            auto objective = minimize_space ? std::get<1>(*predictions[c]) : std::get<2>(*predictions[c]);
+            best_objective = std::min(best_objective.value_or(objective), objective);
+        }
+    }
+    if (!best_objective)
+        return guesses;
+
+    std::printf("%-50s %-19s %-19s\n", "Predicted best index of each class", "Space (KiB)", "Query (ns)");
+    for (size_t c = 0; c < candidates.size(); ++c) {
+        if (!predictions[c]) {
+            guesses[c] = std::nullopt;
+            std::printf("%-50s %-19s %-19s pruned\n", candidates[c].name("ε").c_str(), "-", "-");
+            continue;
+        }
+        auto[eps, bytes, ns] = *predictions[c];
+        auto objective = minimize_space ? bytes : ns;
+        auto pruned = objective > *best_objective * (1 + prune_margin);
+        guesses[c] = pruned ? std::nullopt : std::optional<size_t>(eps);
+        std::printf("%-50s %-19.2f %-19.0f %s\n", candidates[c].name(std::to_string(eps)).c_str(),
+                    bytes / double(1u << 10u), ns, pruned ? "pruned" : "");
+    }
+    std::printf("%s\n", std::string(80, '-').c_str());
+    return guesses;
+}
+
+/**
+ * Runs the search of ε on each candidate and prints the template instantiation that minimises the space within
+ * max_time if @p minimize_space is true, or the query time within max_space otherwise. If @p use_model is true, the
+ * latency model prunes the candidates and restricts the search of the others around the predicted ε.
+ */
+template<typename K>
+void tune(bool minimize_space, size_t max_time_or_space, double tolerance, const std::vector<Candidate> &candidates,
+          size_t data_size, size_t lo_eps, size_t hi_eps, size_t jobs, bool use_model, bool verbose) {
+    std::vector<std::optional<size_t>> guesses(candidates.size(), 0);
+    if (use_model)
+        guesses = predict_with_model<K>(minimize_space, max_time_or_space, candidates, data_size, lo_eps, hi_eps, jobs);
+
+    std::vector<std::pair<const Candidate *, IndexStats>> results;
+    for (size_t c = 0; c < candidates.size(); ++c) {
+        if (!guesses[c])
+            continue;
+        auto &candidate = candidates[c];
+        auto search = [&](size_t lo, size_t hi, size_t guess) {
+            return minimize_space
+                   ? minimize_space_given_time<K>(max_time_or_space, tolerance, candidate, lo, hi, jobs, verbose, guess)
+                   : minimize_time_given_space<K>(max_time_or_space, tolerance, candidate, data_size, lo, hi, jobs,
+                                                  verbose, guess);
+        };
+
+        std::printf("%s\n", candidate.name("ε").c_str());
+        auto guess = *guesses[c];
+        std::optional<IndexStats> best;
+        if (guess) {
+            best = search(std::max(lo_eps, guess / 4), std::min(hi_eps, guess * 4), guess);
+            if (!best)
+                std::printf("Not found around the predicted ε, searching the whole range\n");
+        }
+        if (!best)
+            best = search(lo_eps, hi_eps, 0);
+        if (best)
+            results.emplace_back(&candidate, *best);
+    }
+
+    std::printf("%s\n", std::string(80, '-').c_str());
+    if (results.empty()) {
+        std::printf("It is not possible to satisfy the given constraint. Increase the maximum %s.\n",
+                    minimize_space ? "time" : "space");
+        std::exit(1);
+    }
+
+    auto cmp = [&](const auto &x, const auto &y) {
+        if (minimize_space)
+            return std::make_pair(x.second.bytes, x.second.lookup_ns) < std::make_pair(y.second.bytes, y.second.lookup_ns);
+        return std::make_pair(x.second.lookup_ns, x.second.bytes) < std::make_pair(y.second.lookup_ns, y.second.bytes);
+    };
+    std::sort(results.begin(), results.end(), cmp);
+    std::printf("%-50s %-19s %-19s\n", "Best index of each class", "Space (KiB)", "Query (ns)");
+    for (auto &[candidate, stats] : results) {
+        auto name = candidate->name(std::to_string(stats.epsilon));
+        std::printf("%-50s %-19.2f %-19zu\n", name.c_str(), stats.bytes / double(1u << 10u), stats.lookup_ns);
+    }
+    std::printf("%s\n", std::string(80, '-').c_str());
+
+    auto &[candidate, stats] = results.front();
+    std::printf("Use %s for an index of %zu bytes and %zu±%zu ns per query\n",
+                candidate->name(std::to_string(stats.epsilon)).c_str(), stats.bytes, stats.lookup_ns,
+                stats.lookup_ns_std);
+}
+
+/*------- PARETO FRONTIER -------*/
+
+/** A measured index of a candidate class, seen as a point of the space-time trade-off. */
+struct TradeOffPoint {
+    const Candidate *candidate;
+    IndexStats stats;
+};
+
+/** Returns the points that no other point beats in both space and query time, sorted by increasing space. */
+inline std::vector<TradeOffPoint> pareto_frontier(std::vector<TradeOffPoint> points) {
+    std::sort(points.begin(), points.end(), [](const TradeOffPoint &a, const TradeOffPoint &b) {
+        return std::make_pair(a.stats.bytes, a.stats.lookup_ns) < std::make_pair(b.stats.bytes, b.stats.lookup_ns);
+    });
+    std::vector<TradeOffPoint> frontier;
+    for (auto &p : points)
+        if (frontier.empty() || p.stats.lookup_ns < frontier.back().stats.lookup_ns)
+            frontier.push_back(p);
+    return frontier;
+}
+
+/**
+ * Samples the values of ε of each candidate and prints the Pareto frontier of space and query time over all of them.
+ *
+ * The first round measures each candidate on ε = lo_eps, 4 lo_eps, 16 lo_eps, ... up to hi_eps. Each of the next
+ * rounds looks at the consecutive values of ε of a candidate where at least one of the two indexes is on the frontier
+ * and their sizes differ by more than 10%, and measures the index halfway (on a log scale) between them. So the
+ * frontier is refined only where it can change, and the measurements are shared by all the space budgets. The indexes
+ * of a round are built @p jobs at a time.
+ */
+template<typename K>
+void tune_pareto(const std::vector<Candidate> &candidates, size_t lo_eps, size_t hi_eps, size_t jobs, bool verbose) {
+    const auto max_rounds = 5;
+    std::vector<std::vector<IndexStats>> stats(candidates.size());
+
+    // Measures the given indexes, given as pairs of a candidate and a value of ε, and logs them with the given bounds
+    auto measure_round = [&](const std::vector<std::pair<size_t, size_t>> &indexes,
+                             const std::vector<std::pair<size_t, size_t>> &bounds) {
+        std::vector<std::pair<const Candidate *, size_t>> to_measure;
+        for (auto &[c, eps] : indexes)
+            to_measure.emplace_back(&candidates[c], eps);
+        auto results = measure_all(to_measure, jobs);
+        for (size_t i = 0; i < results.size(); ++i) {
+            auto c = indexes[i].first;
+            if (i == 0 || indexes[i - 1].first != c)
+                std::printf("%s\n", candidates[c].name("ε").c_str());
+            minimize_time_logging(results[i], verbose, bounds[i].first, bounds[i].second);
+            stats[c].push_back(results[i]);
+        }
+    };
+
+    std::vector<std::pair<size_t, size_t>> indexes;
+    for (size_t c = 0; c < candidates.size(); ++c)
+        for (auto eps = lo_eps; eps <= hi_eps; eps *= 4)
+            indexes.emplace_back(c, eps);
+    measure_round(indexes, std::vector<std::pair<size_t, size_t>>(indexes.size(), {lo_eps, hi_eps}));
+
+    auto all_points = [&] {
+        std::vector<TradeOffPoint> points;
+        for (size_t c = 0; c < candidates.size(); ++c)
+            for (auto &s : stats[c])
+                points.push_back({&candidates[c], s});
+        return points;
+    };
+
+    for (auto round = 1; round < max_rounds; ++round) {
+        auto frontier = pareto_frontier(all_points());
+        auto on_frontier = [&](const Candidate &candidate, size_t epsilon) {
+            return std::any_of(frontier.begin(), frontier.end(), [&](const TradeOffPoint &p) {
+                return p.candidate == &candidate && p.stats.epsilon == epsilon;
+            });
+        };
+
+        std::vector<std::pair<size_t, size_t>> next_indexes;
+        std::vector<std::pair<size_t, size_t>> bounds;
+        for (size_t c = 0; c < candidates.size(); ++c) {
+            auto &s = stats[c];
+            std::sort(s.begin(), s.end(), [](auto &a, auto &b) { return a.epsilon < b.epsilon; });
+            for (size_t i = 0; i + 1 < s.size(); ++i) {
+                auto lo = s[i].epsilon;
+                auto hi = s[i + 1].epsilon;
+                auto mid = size_t(std::sqrt(double(lo) * hi));
+                auto bytes_ratio = double(std::max(s[i].bytes, s[i + 1].bytes))
+                                   / std::max<size_t>(std::min(s[i].bytes, s[i + 1].bytes), 1);
+                if (mid <= lo || mid >= hi || bytes_ratio < 1.1)
+                    continue;
+                if (!on_frontier(candidates[c], lo) && !on_frontier(candidates[c], hi))
+                    continue;
+                next_indexes.emplace_back(c, mid);
+                bounds.emplace_back(lo, hi);
+            }
         }
-        std::printf("\n");
+        if (next_indexes.empty())
+            break;
+        measure_round(next_indexes, bounds);
+    }
+
+    auto frontier = pareto_frontier(all_points());
+    std::printf("%s\n", std::string(80, '-').c_str());
+    std::printf("%-50s %-19s %-19s %-19s\n", "Pareto frontier", "Space (KiB)", "Query (ns)", "95% CI (ns)");
+    auto indistinct = false;
+    for (size_t i = 0; i < frontier.size(); ++i) {
+        auto &s = frontier[i].stats;
+        auto name = frontier[i].candidate->name(std::to_string(s.epsilon));
+        auto ci = "[" + std::to_string(size_t(std::max(0., s.lookup_ns - s.lookup_ns_ci()))) + ", "
+                  + std::to_string(size_t(s.lookup_ns + s.lookup_ns_ci())) + "]";
+
+        // Whether the index is not significantly faster than the smaller one before it
+        auto &prev = frontier[i > 0 ? i - 1 : 0].stats;
+        auto overlaps = i > 0 && s.lookup_ns + s.lookup_ns_ci() >= prev.lookup_ns - prev.lookup_ns_ci();
+        indistinct |= overlaps;
+        std::printf("%-50s %-19.2f %-19zu %s%s\n", name.c_str(), s.bytes / double(1u << 10u), s.lookup_ns, ci.c_str(),
+                    overlaps ? " *" : "");
+    }
+    std::printf("%s\n", std::string(80, '-').c_str());
+    if (indistinct)
+        std::printf("* The confidence interval overlaps with the one of the smaller index before it\n");
+}
+
+/*------- DYNAMIC INDEX TUNING -------*/
+
+/** A configuration of DynamicPGMIndex, with the ε of the PGMIndex built on its levels. */
+struct DynamicConfig {
+    uint8_t base;
+    uint8_t buffer_level;
+    uint8_t index_level;
+    size_t epsilon;
+
+    /** Returns the declaration of an index with this configuration, with keys of the given type. */
+    std::string declaration(const std::string &k) const {
+        return "pgm::DynamicPGMIndex<" + k + ", uint64_t, pgm::PGMIndex<" + k + ", " + std::to_string(epsilon)
+            + ">> index(first, last, " + std::to_string(base) + ", " + std::to_string(buffer_level) + ", "
+            + std::to_string(index_level) + ")";
+    }
+};
+
+/** The performance of a DynamicPGMIndex on a sequence of operations. */
+struct DynamicStats {
+    DynamicConfig config;
+    double ops_per_sec;
+    uint64_t insert_ns;   ///< The percentile of the latency of insertions given to measure_dynamic.
+    size_t peak_bytes;    ///< The peak size of the index, sampled during the operations.
+    double merge_fraction; ///< The fraction of the time spent merging the levels.
+};
+
+/**
+ * Bulk loads a DynamicPGMIndex with the given configuration and times the operations on it. One operation every
+ * sample is timed individually to get the latency of insertions.
+ */
+template<typename K, size_t Epsilon>
+DynamicStats measure_dynamic(const DynamicConfig &config, const std::vector<std::pair<K, uint64_t>> &loaded,
+                             const std::vector<DynamicOperation<K>> &operations, double insert_percentile) {
+    const size_t sample = 8;
+    pgm::DynamicPGMIndex<K, uint64_t, pgm::PGMIndex<K, Epsilon>> index(loaded.begin(), loaded.end(), config.base,
+                                                                       config.buffer_level, config.index_level);
+    auto overhead_ns = timer_overhead_ns();
+    auto merge_ns_before = index.merge_stats().nanoseconds;
+    LatencyHistogram insert_latency;
+    size_t peak_bytes = index.size_in_bytes();
+    uint64_t cnt = 0;
+
+    auto t0 = timer::now();
+    for (size_t i = 0; i < operations.size(); ++i) {
+        auto &o = operations[i];
+        if (i % sample != 0 || o.type != DynamicOperation<K>::Insert) {
+            run_operation(index, o, cnt);
+            continue;
+        }
+        auto t = timer::now();
+        run_operation(index, o, cnt);
+        auto ns = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(timer::now() - t).count());
+        insert_latency.record(ns > overhead_ns ? ns - overhead_ns : 0);
+        if (i % (1024 * sample) == 0)
+            peak_bytes = std::max(peak_bytes, index.size_in_bytes());
+    }
+    auto t1 = timer::now();
+    [[maybe_unused]] volatile auto tmp = cnt;
+
+    auto elapsed_ns = std::max<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count(), 1);
+    auto merge_ns = index.merge_stats().nanoseconds - merge_ns_before;
+    return {config, operations.size() / (elapsed_ns / 1e9), insert_latency.percentile(insert_percentile),
+            std::max(peak_bytes, index.size_in_bytes()), merge_ns / elapsed_ns};
+}
+
+/** Dispatches to measure_dynamic with the ε of the configuration, which must be one of the ε in dynamic_epsilons. */
+template<typename K>
+DynamicStats measure_dynamic(const DynamicConfig &config, const std::vector<std::pair<K, uint64_t>> &loaded,
+                             const std::vector<DynamicOperation<K>> &operations, double insert_percentile) {
+    switch (config.epsilon) {
+        case 16: return measure_dynamic<K, 16>(config, loaded, operations, insert_percentile);
+        case 32: return measure_dynamic<K, 32>(config, loaded, operations, insert_percentile);
+        case 64: return measure_dynamic<K, 64>(config, loaded, operations, insert_percentile);
+        case 128: return measure_dynamic<K, 128>(config, loaded, operations, insert_percentile);
+        default: throw std::invalid_argument("Unsupported epsilon " + std::to_string(config.epsilon));
+    }
+}
+
+/** The ε of the PGMIndex on the levels that the dynamic tuning tries. The first is the default of DynamicPGMIndex. */
+inline const std::vector<size_t> dynamic_epsilons = {16, 32, 64, 128};
+
+/**
+ * Reads a trace of operations from a text file with one operation per line: a letter among i (insert), u (update),
+ * e (erase), f (find), s (scan) and r (read-modify-write), the key, and, for scans, the number of keys to read.
+ */
+template<typename K>
+std::vector<DynamicOperation<K>> read_operations(const std::string &filename) {
+    using op = DynamicOperation<K>;
+    std::ifstream in(filename);
+    if (!in)
+        throw std::invalid_argument("Could not read the operations file " + filename);
+
+    std::vector<op> operations;
+    size_t line_number = 0;
+    for (std::string line; std::getline(in, line);) {
+        ++line_number;
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream ss(line);
+        char type;
+        K key;
+        uint32_t length = 0;
+        if (!(ss >> type >> key) || (type == 's' && !(ss >> length)))
+            throw std::invalid_argument("Malformed operation at line " + std::to_string(line_number) + " of "
+                                        + filename);
+        switch (type) {
+            case 'i': operations.push_back({op::Insert, 0, key}); break;
+            case 'u': operations.push_back({op::Update, 0, key}); break;
+            case 'e': operations.push_back({op::Erase, 0, key}); break;
+            case 'f': operations.push_back({op::Find, 0, key}); break;
+            case 's': operations.push_back({op::Scan, length, key}); break;
+            case 'r': operations.push_back({op::ReadModifyWrite, 0, key}); break;
+            default:
+                throw std::invalid_argument("Unknown operation '" + std::string(1, type) + "' at line "
+                                            + std::to_string(line_number) + " of " + filename);
+        }
+    }
+    if (operations.empty())
+        throw std::invalid_argument("The operations file " + filename + " is empty");
+    return operations;
+}
+
+/** Returns the smallest level whose maximum size base^level is at least the given size. */
+inline uint8_t level_of_size(uint8_t base, size_t size) {
+    uint8_t level = 0;
+    for (size_t capacity = 1; capacity < size; capacity *= base)
+        ++level;
+    return level;
+}
+
+/**
+ * Replays the operations on DynamicPGMIndex with each base, with levels 0 and with indexes starting at a few sizes,
+ * and prints the configuration with the highest throughput whose peak space is within max_bytes and whose latency of
+ * insertions (at the given percentile) is within max_insert_ns.
+ *
+ * The search first tries all the combinations of base, buffer_level and index_level with the default ε of the
+ * PGMIndex on the levels, then tries the other ε on the best few of them.
+ */
+template<typename K>
+void tune_dynamic(const std::vector<std::pair<K, uint64_t>> &loaded, const std::vector<DynamicOperation<K>> &operations,
+                  const std::vector<uint8_t> &bases, size_t max_bytes, uint64_t max_insert_ns,
+                  double insert_percentile) {
+    const size_t refined_configs = 3;
+    const std::vector<size_t> buffer_sizes = {1 << 7, 1 << 10, 1 << 13};
+    const std::vector<size_t> index_sizes = {1 << 16, 1 << 20, 1 << 24};
+
+    auto feasible = [&](const DynamicStats &s) { return s.peak_bytes <= max_bytes && s.insert_ns <= max_insert_ns; };
+    auto better = [&](const DynamicStats &x, const DynamicStats &y) {
+        return feasible(x) != feasible(y) ? feasible(x) : x.ops_per_sec > y.ops_per_sec;
+    };
+
+    std::ostringstream percentile;
+    percentile << "p" << insert_percentile;
+    auto latency_header = "Insert " + percentile.str() + " (ns)";
+    std::printf("%-8s %-8s %-8s %-8s %-19s %-19s %-19s\n", "Base", "Buffer", "Index", "Epsilon", "Throughput (op/s)",
+                latency_header.c_str(), "Peak space (KiB)");
+    std::printf("%s\n", std::string(80, '-').c_str());
+
+    std::vector<DynamicStats> results;
+    auto measure = [&](const DynamicConfig &config) {
+        auto &s = results.emplace_back(measure_dynamic(config, loaded, operations, insert_percentile));
+        std::printf("%-8d %-8d %-8d %-8zu %-19.0f %-19llu %-19.2f%s\n", config.base, config.buffer_level,
+                    config.index_level, config.epsilon, s.ops_per_sec, (unsigned long long) s.insert_ns,
+                    s.peak_bytes / double(1u << 10u), feasible(s) ? "" : " ✗");
         std::fflush(stdout);
+    };
+
+    std::vector<DynamicConfig> configs;
+    for (auto base : bases) {
+        for (auto buffer_size : buffer_sizes) {
+            for (auto index_size : index_sizes) {
+                auto buffer_level = std::max<uint8_t>(level_of_size(base, buffer_size), 1);
+                auto index_level = std::max<uint8_t>(level_of_size(base, index_size), buffer_level + 1);
+                DynamicConfig config{base, buffer_level, index_level, dynamic_epsilons.front()};
+                auto same = [&](const DynamicConfig &c) {
+                    return c.base == base && c.buffer_level == buffer_level && c.index_level == index_level;
+                };
+                if (std::none_of(configs.begin(), configs.end(), same))
+                    configs.push_back(config);
+            }
+        }
+    }
+    for (auto &config : configs)
+        measure(config);
 
-        if (stats.bytes <= max_space)
-            hi = mid;
-        else
-            lo = mid + 1;
-    } while (lo < hi && std::abs(all_stats.back().bytes - (double) max_space) > max_space * tolerance);
+    auto first_round = results;
+    std::sort(first_round.begin(), first_round.end(), better);
+    first_round.resize(std::min(first_round.size(), refined_configs));
+    for (auto &s : first_round)
+        for (auto it = std::next(dynamic_epsilons.begin()); it != dynamic_epsilons.end(); ++it)
+            measure({s.config.base, s.config.buffer_level, s.config.index_level, *it});
 
     std::printf("%s\n", std::string(80, '-').c_str());
-    std::printf("Set epsilon to %zu\n", lo);
+    if (std::any_of(results.begin(), results.end(), [&](auto &s) { return !feasible(s); }))
+        std::printf("✗ Exceeds the maximum space or the maximum latency of insertions\n");
+    auto best = std::min_element(results.begin(), results.end(), better);
+    if (!feasible(*best)) {
+        std::printf("It is not possible to satisfy the given constraints. Increase the maximum space or latency.\n");
+        return;
+    }
+    std::printf("Use %s for %.0f op/s, an insertion latency of %llu ns at %s and a peak space of %zu bytes\n",
+                best->config.declaration(key_type_name<K>()).c_str(), best->ops_per_sec, (unsigned long long) best->insert_ns,
+                percentile.str().c_str(), best->peak_bytes);
 }
 
-/*------- cache_line_size() implementation (credits: https://stackoverflow.com/a/4049562) -------*/
+/*------- cache_line_size() and cache_sizes() implementation (credits: https://stackoverflow.com/a/4049562) -------*/
 
 #if defined(__APPLE__)
 
@@ -308,6 +1173,21 @@ size_t cache_line_size() {
     return line_size;
 }
 
+CacheSizes cache_sizes() {
+    CacheSizes sizes = {32ul << 10, 1ul << 20, 8ul << 20};
+    auto read = [](const char *name, size_t &size) {
+        uint64_t value = 0;
+        size_t sizeof_value = sizeof(value);
+        if (sysctlbyname(name, &value, &sizeof_value, 0, 0) == 0 && value > 0)
+            size = value;
+    };
+    read("hw.l1dcachesize", sizes.l1);
+    read("hw.l2cachesize", sizes.l2);
+    sizes.llc = sizes.l2;
+    read("hw.l3cachesize", sizes.llc);
+    return sizes;
+}
+
 #elif defined(_WIN32)
 
 #include <stdlib.h>
@@ -333,6 +1213,32 @@ size_t cache_line_size() {
     return line_size;
 }
 
+CacheSizes cache_sizes() {
+    CacheSizes sizes = {32ul << 10, 1ul << 20, 8ul << 20};
+    DWORD buffer_size = 0;
+    GetLogicalProcessorInformation(0, &buffer_size);
+    auto buffer = (SYSTEM_LOGICAL_PROCESSOR_INFORMATION *) malloc(buffer_size);
+    GetLogicalProcessorInformation(&buffer[0], &buffer_size);
+
+    size_t llc_level = 0;
+    for (DWORD i = 0; i != buffer_size / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION); ++i) {
+        auto &cache = buffer[i].Cache;
+        if (buffer[i].Relationship != RelationCache || cache.Type == CacheInstruction)
+            continue;
+        if (cache.Level == 1)
+            sizes.l1 = cache.Size;
+        if (cache.Level == 2)
+            sizes.l2 = cache.Size;
+        if (cache.Level >= 2 && cache.Level >= llc_level) {
+            llc_level = cache.Level;
+            sizes.llc = cache.Size;
+        }
+    }
+
+    free(buffer);
+    return sizes;
+}
+
 #elif defined(linux)
 
 size_t cache_line_size() {
@@ -345,6 +1251,43 @@ size_t cache_line_size() {
     return i;
 }
 
+CacheSizes cache_sizes() {
+    CacheSizes sizes = {32ul << 10, 1ul << 20, 8ul << 20};
+    size_t llc_level = 0;
+    for (auto index = 0;; ++index) {
+        auto path = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(index) + "/";
+        FILE *level_file = std::fopen((path + "level").c_str(), "r");
+        FILE *type_file = std::fopen((path + "type").c_str(), "r");
+        FILE *size_file = std::fopen((path + "size").c_str(), "r");
+        unsigned int level = 0;
+        size_t size = 0;
+        char type[32] = {0};
+        char unit = 'B';
+        auto ok = level_file && type_file && size_file
+            && std::fscanf(level_file, "%u", &level) == 1
+            && std::fscanf(type_file, "%31s", type) == 1
+            && std::fscanf(size_file, "%zu%c", &size, &unit) >= 1;
+        for (auto f : {level_file, type_file, size_file})
+            if (f)
+                std::fclose(f);
+        if (!ok)
+            break;
+
+        if (std::string(type) == "Instruction")
+            continue;
+        size <<= unit == 'K' ? 10 : unit == 'M' ? 20 : unit == 'G' ? 30 : 0;
+        if (level == 1)
+            sizes.l1 = size;
+        if (level == 2)
+            sizes.l2 = size;
+        if (level >= 2 && level >= llc_level) {
+            llc_level = level;
+            sizes.llc = size;
+        }
+    }
+    return sizes;
+}
+
 #else
 #error Unrecognized platform
 #endif
\ No newline at end of file